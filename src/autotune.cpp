@@ -0,0 +1,297 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "autotune.hpp"
+#include "util.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <zstd/zstd.h>
+
+
+static const constexpr std::size_t sample_runs = 8, run_size = 128 * 1024;
+/// Fast trials are repeated for at least this long, to be timed with any accuracy.
+static const constexpr std::chrono::milliseconds min_trial_time{50};
+
+/// {level, strategy}, fastest to slowest: the levels' own strategies, and a cheaper and a more thorough one at the common middle levels.
+static const constexpr std::pair<int, int> candidates[] = {{-5, 0}, {-1, 0}, {1, 0},  {2, 0},  {3, 0},  {3, ZSTD_lazy}, {5, 0},
+                                                           {7, 0},  {9, 0},  {9, ZSTD_btopt}, {12, 0}, {15, 0}, {17, 0},  {19, 0}};
+
+
+/// Return value: sample_runs runs of run_size spread evenly over the specified {path, size} files, as if concatenated, or all of the first if they're smaller.
+static std::string take_sample(const std::vector<std::pair<std::string, std::uint64_t>> & files, std::uint64_t total) {
+	const auto runs = total > sample_runs * run_size ? sample_runs : 1;
+	const auto len  = total > sample_runs * run_size ? run_size : total;
+
+	std::string ret;
+	std::size_t file{};
+	std::uint64_t file_start{};
+	for(std::size_t run = 0; run != runs; ++run) {
+		const auto offset = total / runs * run;
+		while(file != files.size() && offset >= file_start + files[file].second)
+			file_start += files[file++].second;
+		if(file == files.size())
+			break;
+
+		// Runs are cut short at the end of the file they start in
+		std::ifstream in(files[file].first, std::ios::binary);
+		const auto start = offset - file_start;
+		const auto old   = ret.size();
+		ret.resize(old + std::min<std::uint64_t>(len, files[file].second - start));
+		in.seekg(start).read(ret.data() + old, ret.size() - old);
+		ret.resize(old + in.gcount());
+	}
+	return ret;
+}
+
+/// Return value: how fast, in MB/s, the temporary directory takes writes all the way to the disk, 0 if it couldn't be written to.
+static double measure_disk_speed() {
+	static const constexpr std::size_t block_size = 1024 * 1024, blocks = 64;
+
+	char dir[MAX_PATH + 1];
+	const auto dir_len = GetTempPathA(sizeof(dir), dir);
+	if(!dir_len || dir_len > sizeof(dir))
+		return 0;
+	const auto path = std::string(dir, dir_len) + "totalcmd-zstd-calibration.tmp";
+	const auto file = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_FLAG_WRITE_THROUGH | FILE_FLAG_DELETE_ON_CLOSE, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return 0;
+
+	// Random, so compressed volumes don't flatter it
+	std::vector<std::uint64_t> block(block_size / sizeof(std::uint64_t));
+	std::uint64_t state = 0x9E3779B97F4A7C15;
+	for(auto && word : block) {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		word = state;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	auto ok          = true;
+	for(std::size_t i = 0; i != blocks && ok; ++i) {
+		DWORD written;
+		ok = WriteFile(file, block.data(), block_size, &written, nullptr) && written == block_size;
+	}
+	ok                 = ok && FlushFileBuffers(file);
+	const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	CloseHandle(file);
+	return ok && elapsed > 0 ? blocks * block_size / elapsed / 1e6 : 0;
+}
+
+
+std::vector<trial_result> run_trials(const std::string & sample, const worker_share & share, const std::function<bool(const trial_result &)> & enough) {
+	std::vector<std::optional<trial_result>> trials(std::size(candidates));
+	std::atomic<std::size_t> last{trials.size() - 1};
+	if(!sample.empty())
+		parallel_for(share, trials.size(), [&](std::size_t i) {
+			if(i > last)
+				return;
+			const auto [level, strategy] = candidates[i];
+
+			std::unique_ptr<ZSTD_CCtx, decltype(&ZSTD_freeCCtx)> ctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+			ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel, level);
+			ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_strategy, strategy);
+			auto out = std::make_unique<char[]>(ZSTD_compressBound(sample.size()));
+
+			std::size_t compressed{}, rounds{};
+			std::chrono::duration<double> elapsed{};
+			for(const auto start = std::chrono::steady_clock::now(); elapsed < min_trial_time; elapsed = std::chrono::steady_clock::now() - start) {
+				compressed = ZSTD_compress2(ctx.get(), out.get(), ZSTD_compressBound(sample.size()), sample.data(), sample.size());
+				++rounds;
+			}
+			if(ZSTD_isError(compressed) || !compressed)
+				compressed = sample.size();
+
+			trials[i] = {level, strategy, rounds * sample.size() / elapsed.count() / 1e6, static_cast<double>(sample.size()) / compressed};
+			if(enough && enough(*trials[i]))
+				for(auto cur = last.load(); i < cur && !last.compare_exchange_weak(cur, i);)
+					;
+		});
+
+	std::vector<trial_result> ret;
+	for(auto && trial : trials)
+		if(trial)
+			ret.emplace_back(*trial);
+	return ret;
+}
+
+const trial_result & pick_trial(const std::vector<trial_result> & trials, autotune_goal goal, const configuration & cfg, std::size_t workers) {
+	const auto speed    = [&](const trial_result & trial) { return trial.speed * workers; };
+	const auto by_speed = [&](const trial_result & lhs, const trial_result & rhs) { return speed(lhs) < speed(rhs); };
+	const auto by_ratio = [](const trial_result & lhs, const trial_result & rhs) { return lhs.ratio < rhs.ratio; };
+
+	const trial_result * best{};
+	switch(goal) {
+		case autotune_goal::speed:
+			for(auto && trial : trials)
+				if(speed(trial) >= cfg.autotune_speed && (!best || by_ratio(*best, trial)))
+					best = &trial;
+			return best ? *best : *std::max_element(trials.begin(), trials.end(), by_speed);
+
+		case autotune_goal::ratio:
+			for(auto && trial : trials)
+				if(trial.ratio >= cfg.autotune_ratio && (!best || by_speed(*best, trial)))
+					best = &trial;
+			return best ? *best : *std::max_element(trials.begin(), trials.end(), by_ratio);
+
+		default: {
+			// Per MB of input: the input's read and the output written while compressing, so whichever's slower sets the pace
+			const auto time = [&](const trial_result & trial) {
+				return std::max(1 / speed(trial), cfg.disk_speed > 0 ? (1 + 1 / trial.ratio) / cfg.disk_speed : 0);
+			};
+			return *std::min_element(trials.begin(), trials.end(), [&](auto && lhs, auto && rhs) { return time(lhs) < time(rhs); });
+		}
+	}
+}
+
+/// Return value: sample_runs runs of run_size, like a sample of what gets packed: text (prose and logs), structured binary (tables of records), and incompressible
+/// (already-compressed) data, in 3:3:2 proportion, always the same.
+static std::string calibration_corpus() {
+	std::uint64_t state = 0x9E3779B97F4A7C15;  // xorshift64
+	const auto next     = [&] {
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	};
+
+	static const char * const words[] = {"the",     "of",     "and",  "to",      "in",      "is",     "that",   "for",   "it",     "as",   "with",
+	                                     "was",     "on",     "be",   "by",      "this",    "are",    "from",   "or",    "which",  "file", "archive",
+	                                     "request", "server", "data", "handled", "returned", "error",  "value",  "count", "between", "time", "process"};
+	static const char * const levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+	const auto text                    = [&](std::string & out) {
+		const auto end = out.size() + run_size;
+		std::uint64_t clock{1700000000};
+		while(out.size() < end)
+			if(next() % 2) {  // A sentence, commoner words likelier
+				for(auto n = 4 + next() % 12; n; --n) {
+					const auto r = next() % std::size(words);
+					out += words[r * (next() % std::size(words)) / std::size(words)];
+					out += n == 1 ? ".\n" : " ";
+				}
+			} else {  // A log line
+				clock += next() % 5;
+				out += std::to_string(clock) + ' ' + levels[next() % std::size(levels)] + " worker-" + std::to_string(next() % 8) + ' ' +
+				       words[next() % std::size(words)] + " id=" + std::to_string(next() % 100000) + " in " + std::to_string(next() % 1000) + " ms\n";
+			}
+		out.resize(end);
+	};
+	const auto binary = [&](std::string & out) {
+		struct {
+			std::uint32_t id, timestamp;
+			float value;
+			std::uint16_t flags, reserved;
+		} record{};
+		for(std::size_t i = 0; i != run_size / sizeof(record); ++i) {
+			++record.id;
+			record.timestamp += next() % 16;
+			record.value = static_cast<float>(next() % 10000) / 100;
+			record.flags = 1u << (next() % 4);
+			char bytes[sizeof(record)];
+			std::memcpy(bytes, &record, sizeof(record));
+			out.append(bytes, sizeof(record));
+		}
+	};
+	const auto random = [&](std::string & out) {
+		for(std::size_t i = 0; i != run_size / sizeof(std::uint64_t); ++i) {
+			const auto word = next();
+			char bytes[sizeof(word)];
+			std::memcpy(bytes, &word, sizeof(word));
+			out.append(bytes, sizeof(word));
+		}
+	};
+
+	std::string ret;
+	ret.reserve(sample_runs * run_size);
+	const std::function<void(std::string &)> runs[] = {text, binary, random, text, binary, text, binary, random};
+	for(auto && run : runs)
+		run(ret);
+	return ret;
+}
+
+std::optional<trial_result> autotune(const std::string & src_path, const std::vector<std::string> & names, const char * contained_name, const configuration & cfg) {
+	if(cfg.autotune == autotune_goal::off)
+		return std::nullopt;
+	if(const auto rule = cfg.rule_for(contained_name); rule && rule->level)
+		return std::nullopt;
+
+	std::vector<std::pair<std::string, std::uint64_t>> files;
+	std::uint64_t total{};
+	for(auto && name : names) {
+		auto path = src_path + name;
+		std::error_code ec;
+		if(!std::filesystem::is_regular_file(path, ec))
+			continue;
+		const auto size = std::filesystem::file_size(path, ec);
+		if(ec || !size)
+			continue;
+		files.emplace_back(std::move(path), size);
+		total += size;
+	}
+	if(total < autotune_min_size)
+		return std::nullopt;
+
+	// Slower levels only get slower, and mostly better ratios: past the first trial too slow for the speed, or already at the ratio, they can't do better.
+	// The trials run on the share the archive will have, before it claims its own
+	const worker_share share;
+	const auto workers = share.workers();
+	const auto enough  = [&](const trial_result & trial) {
+		switch(cfg.autotune) {
+			case autotune_goal::speed:
+				return trial.speed * workers < cfg.autotune_speed;
+			case autotune_goal::ratio:
+				return trial.ratio >= cfg.autotune_ratio;
+			default:  // Compressing already takes longer than reading and writing
+				return cfg.disk_speed > 0 && 1 / (trial.speed * workers) > (1 + 1 / trial.ratio) / cfg.disk_speed;
+		}
+	};
+	const auto trials = run_trials(take_sample(files, total), share, enough);
+	if(trials.empty())
+		return std::nullopt;
+	return pick_trial(trials, cfg.autotune, cfg, workers);
+}
+
+std::vector<trial_result> calibrate(configuration & cfg) {
+	const worker_share share;
+	auto trials = run_trials(calibration_corpus(), share, {});
+
+	// compression‐level can't go below 0 nor set a strategy
+	std::vector<trial_result> plain;
+	std::copy_if(trials.begin(), trials.end(), std::back_inserter(plain), [](auto && trial) { return trial.level > 0 && !trial.strategy; });
+	if(plain.empty())
+		return trials;
+
+	if(const auto disk_speed = measure_disk_speed())
+		cfg.disk_speed = disk_speed;
+	cfg.autotune_speed    = cfg.disk_speed;
+	cfg.compression_level = pick_trial(plain, autotune_goal::time, cfg, share.workers()).level;
+	return trials;
+}
@@ -0,0 +1,72 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include "config.hpp"
+#include "worker_pool.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+/// Less input than this isn't worth trial-compressing samples of first.
+static const constexpr std::uint64_t autotune_min_size = 64 * 1024 * 1024;
+
+
+/// How a level and strategy did compressing a sample.
+struct trial_result {
+	int level;
+	/// One of ZSTD_strategy, 0 for the level's own.
+	int strategy;
+	/// Of the input, in MB/s (10⁶ bytes), on one thread.
+	double speed;
+	double ratio;
+};
+
+
+/// Trial-compress the specified sample with each of a range of levels and strategies, from -5 to 19, fastest to slowest,
+/// on the specified share of threads, skipping those after the first that enough(), if set, returns true for.
+///
+/// Return value: the trials run, in that order, or none if the sample's empty.
+std::vector<trial_result> run_trials(const std::string & sample, const worker_share & share, const std::function<bool(const trial_result &)> & enough);
+
+/// Pick the trial best meeting the specified goal, which mustn't be off, packing on the specified number of workers.
+///
+/// Speeds are assumed to scale with the workers. When none of the trials reach the configured speed or ratio the closest is picked.
+const trial_result & pick_trial(const std::vector<trial_result> & trials, autotune_goal goal, const configuration & cfg, std::size_t workers);
+
+/// Pick the level and strategy for packing the specified files into an archive containing the specified name, as configured with "autotune".
+///
+/// Up to 1 MiB, in runs spread evenly over all the files, are trial-compressed.
+///
+/// Return value: nullopt if it's off, there's less than autotune_min_size of input, a compression rule sets the level, or the files couldn't be read.
+std::optional<trial_result> autotune(const std::string & src_path, const std::vector<std::string> & names, const char * contained_name, const configuration & cfg);
+
+/// Benchmark compressing a generated mix of text, binary, and incompressible data, and writing to the temporary directory,
+/// then set disk_speed to the latter, autotune_speed to match it, and compression_level to the one taking the least time at that speed.
+///
+/// Return value: the trials; if none of them were at a level above 0 with its own strategy, the configuration's left as it was.
+std::vector<trial_result> calibrate(configuration & cfg);
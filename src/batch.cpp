@@ -0,0 +1,184 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "batch.hpp"
+#include "unpack_data.hpp"
+#include "util.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <thread>
+#include <utility>
+#include <wcxhead.h>
+
+
+/// The name the archive records, reduced to its last component, or nothing if that wouldn't name a file in the destination.
+static std::string output_name(unarchive_data & ctx) {
+	const std::filesystem::path recorded = ctx.derive_contained_name();
+	if(recorded.empty() || recorded.has_root_path())
+		return {};
+
+	const auto leaf = recorded.filename();
+	if(leaf.empty() || leaf == "." || leaf == "..")
+		return {};
+	return leaf.string();
+}
+
+/// Claim a name not yet claimed in the batch, case-insensitively: the name, or "name (2).ext", "name (3).ext", &c.
+static std::string claim_name(std::set<std::string> & claimed, const std::string & name) {
+	const auto ext  = name.find_last_of('.');
+	const auto stem = name.substr(0, ext == 0 ? std::string::npos : ext);
+	auto candidate  = name;
+	for(std::size_t n = 2;; ++n) {
+		if(claimed.emplace(lowercase(candidate)).second)
+			return candidate;
+		candidate = stem + " (" + std::to_string(n) + ')' + name.substr(stem.size());
+	}
+}
+
+/// Return value: 0 or the error testing the archive, or extracting it into path if not empty, failed with.
+static int process_archive(unarchive_data & ctx, bool extract, const std::string & path) {
+	if(!extract) {
+		null_streambuf nothing;
+		std::ostream out(&nothing);
+		return ctx.unpack(out);
+	}
+	if(path.empty())
+		return E_BAD_DATA;
+
+	const auto err = ctx.unpack_to(path.c_str());
+	if(const auto mtime = ctx.original_mtime(); !err && mtime)
+		set_file_mtime(path.c_str(), *mtime);
+	return err;
+}
+
+
+std::vector<int> process_archives(const std::vector<std::string> & archives, const char * dest_dir, const batch_callback & done) {
+	std::vector<int> results(archives.size(), E_EABORTED);
+	if(archives.empty())
+		return results;
+	const configuration cfg;
+	// Taken before the decoders claim shares of their own
+	const auto workers = std::min(worker_share{}.workers(), archives.size());
+
+	std::string dest = dest_dir ? dest_dir : "";
+	if(!dest.empty() && dest.back() != '\\' && dest.back() != '/')
+		dest += '\\';
+	// Assigned in order as the archives are opened, so those recording the same name don't overwrite one another
+	std::vector<std::string> outputs(archives.size());
+	std::set<std::string> claimed;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<std::pair<std::size_t, std::unique_ptr<unarchive_data>>> opened;
+	bool opened_all = false, stopping = false;
+	std::vector<std::size_t> retry;
+
+	// Separately, so a slow callback holds up only the others finishing
+	std::mutex reporting;
+	bool stopped = false;
+	const auto report = [&](std::size_t index, int err) {
+		std::lock_guard<std::mutex> guard(reporting);
+		results[index] = err;
+		if(!stopped && !done(index, err))
+			stopped = true;
+		return !stopped;
+	};
+
+	// Opened in order, as many ahead of the ones being decoded as are decoded at once
+	std::thread opener([&] {
+		for(std::size_t i = 0; i != archives.size(); ++i) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return stopping || opened.size() < workers; });
+				if(stopping)
+					break;
+			}
+
+			auto ctx = std::make_unique<unarchive_data>(archives[i].c_str(), cfg);
+			ctx->prefetch();
+			if(dest_dir)
+				if(const auto name = output_name(*ctx); !name.empty())
+					outputs[i] = dest + claim_name(claimed, name);
+
+			std::lock_guard<std::mutex> guard(lock);
+			opened.emplace_back(i, std::move(ctx));
+			changed.notify_all();
+		}
+
+		std::lock_guard<std::mutex> guard(lock);
+		opened_all = true;
+		changed.notify_all();
+	});
+
+	const auto work = [&] {
+		std::unique_lock<std::mutex> guard(lock);
+		for(;;) {
+			changed.wait(guard, [&] { return stopping || opened_all || !opened.empty(); });
+			if(stopping || opened.empty())
+				return;
+
+			auto [index, ctx] = std::move(opened.front());
+			opened.pop_front();
+			changed.notify_all();
+
+			guard.unlock();
+			const auto err = process_archive(*ctx, dest_dir, outputs[index]);
+			ctx.reset();
+
+			// It may fit once the others are done
+			if(err == E_NO_MEMORY && workers > 1) {
+				guard.lock();
+				retry.emplace_back(index);
+				continue;
+			}
+			const auto keep_going = report(index, err);
+			guard.lock();
+			if(!keep_going) {
+				stopping = true;
+				changed.notify_all();
+			}
+		}
+	};
+
+	std::vector<std::thread> threads(workers);
+	for(auto && t : threads)
+		t = std::thread(work);
+	for(auto && t : threads)
+		t.join();
+	opener.join();
+
+	std::sort(retry.begin(), retry.end());
+	for(auto index : retry) {
+		if(stopping)
+			break;
+		unarchive_data ctx(archives[index].c_str(), cfg);
+		stopping = !report(index, process_archive(ctx, dest_dir, outputs[index]));
+	}
+	return results;
+}
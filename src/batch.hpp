@@ -0,0 +1,47 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+
+/// Called with the index of each archive as it's done, and 0 or the error it failed with, one at a time, in the order they finish.
+/// Return false to stop: the archives being processed are finished, and the rest left with E_EABORTED.
+using batch_callback = std::function<bool(std::size_t index, int err)>;
+
+
+/// Test the specified archives, or extract them into dest_dir if it's not nullptr, several at once, for bulk restores of many small ones.
+///
+/// Each is decoded on a thread of its own, up to the thread budget's share at a time, while the next as many are opened
+/// and their metadata and first MiB read ahead; no more than about twice that are open at once. Those refused with E_NO_MEMORY
+/// while others were taking up the process memory budget are retried on their own at the end.
+///
+/// Extracted files are named after the last component of the name recorded, with " (2)", " (3)", &c. added to the later of those
+/// recording the same one, and get the recorded modification time; those recording no usable name fail with E_BAD_DATA.
+///
+/// Return value: 0 or the error of each archive, as from ProcessFile().
+std::vector<int> process_archives(const std::vector<std::string> & archives, const char * dest_dir, const batch_callback & done);
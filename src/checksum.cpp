@@ -0,0 +1,123 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "checksum.hpp"
+#include <algorithm>
+#include <wcxhead.h>
+
+
+content_hash::content_hash(bool with_sha256) : sha256_alg(nullptr), sha256(nullptr) {
+	XXH64_reset(&xxh64, 0);
+	if(with_sha256 && BCRYPT_SUCCESS(BCryptOpenAlgorithmProvider(&sha256_alg, BCRYPT_SHA256_ALGORITHM, nullptr, 0)))
+		if(!BCRYPT_SUCCESS(BCryptCreateHash(sha256_alg, &sha256, nullptr, 0, nullptr, 0, 0)))
+			sha256 = nullptr;
+}
+
+content_hash::~content_hash() {
+	if(sha256)
+		BCryptDestroyHash(sha256);
+	if(sha256_alg)
+		BCryptCloseAlgorithmProvider(sha256_alg, 0);
+}
+
+void content_hash::update(const void * data, std::size_t len) {
+	XXH64_update(&xxh64, data, len);
+	if(sha256)
+		for(auto cur = static_cast<const unsigned char *>(data); len;) {  // CNG takes ULONG lengths
+			const auto piece = static_cast<ULONG>(std::min<std::size_t>(len, 0x40000000));
+			BCryptHashData(sha256, const_cast<PUCHAR>(cur), piece, 0);
+			cur += piece;
+			len -= piece;
+		}
+}
+
+void content_hash::finish(archive_metadata & into) {
+	into.content_xxh64 = XXH64_digest(&xxh64);
+	into.content_sha256.clear();
+	if(sha256) {
+		unsigned char digest[32];
+		if(BCRYPT_SUCCESS(BCryptFinishHash(sha256, digest, sizeof(digest), 0)))
+			for(auto byte : digest) {
+				into.content_sha256 += "0123456789abcdef"[byte >> 4];
+				into.content_sha256 += "0123456789abcdef"[byte & 0xF];
+			}
+		BCryptDestroyHash(sha256);
+		sha256 = nullptr;
+	}
+}
+
+bool content_hash::matches(const archive_metadata & meta) {
+	archive_metadata got;
+	finish(got);
+	// A SHA-256 CNG couldn't compute is left unchecked, the XXH64 still is
+	return (!meta.content_xxh64 || meta.content_xxh64 == got.content_xxh64) &&
+	       (meta.content_sha256.empty() || got.content_sha256.empty() || meta.content_sha256 == got.content_sha256);
+}
+
+
+content_verifier::content_verifier(const archive_metadata & meta, std::size_t depth, std::size_t chunk_size)
+      : meta(meta), hash(!meta.content_sha256.empty()), hashed(depth, chunk_size), cur(nullptr), matched(false) {
+	hasher = std::thread([this] {
+		while(const auto chunk = hashed.next()) {
+			if(!chunk->size) {
+				matched = hash.matches(this->meta);
+				break;
+			}
+			hash.update(chunk->data, chunk->size);
+		}
+	});
+}
+
+content_verifier::~content_verifier() {
+	if(hasher.joinable()) {
+		hashed.finish(E_EABORTED);
+		hasher.join();
+	}
+}
+
+bool content_verifier::applies_to(const archive_metadata & meta) {
+	return meta.content_xxh64 || !meta.content_sha256.empty();
+}
+
+char * content_verifier::buffer() {
+	if(!cur)
+		cur = hashed.acquire();
+	return cur->data;
+}
+
+std::size_t content_verifier::chunk_size() const {
+	return hashed.chunk_size();
+}
+
+void content_verifier::consume(std::size_t len) {
+	if(!len)
+		return;
+	cur->size = len;
+	hashed.publish();
+	cur = nullptr;
+}
+
+int content_verifier::verify() {
+	hashed.finish(0);
+	hasher.join();
+	return matched ? 0 : E_BAD_DATA;
+}
@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "chunk_queue.hpp"
+#include "metadata.hpp"
+#include <bcrypt.h>
+#include <cstdint>
+#include <string>
+#include <thread>
+#define XXH_STATIC_LINKING_ONLY
+#include <zstd/common/xxhash.h>
+
+
+/// XXH64 of everything passed through it, and optionally SHA-256, with CNG, as recorded in the metadata frame.
+class content_hash {
+private:
+	XXH64_state_t xxh64;
+	BCRYPT_ALG_HANDLE sha256_alg;
+	BCRYPT_HASH_HANDLE sha256;
+
+
+public:
+	content_hash(bool with_sha256);
+	~content_hash();
+	content_hash(const content_hash &) = delete;
+	content_hash(content_hash &&)      = delete;
+
+	void update(const void * data, std::size_t len);
+
+	/// Record the hashes of everything passed so far. Call once, at the end.
+	void finish(archive_metadata & into);
+
+	/// Return value: whether the hashes of everything passed so far match those recorded, if any. Call once, at the end.
+	bool matches(const archive_metadata & meta);
+};
+
+/// Hashes what's decoded into its buffers on a thread of its own, so checking it doesn't slow decoding down.
+class content_verifier {
+private:
+	const archive_metadata & meta;
+	content_hash hash;
+	chunk_queue hashed;
+	chunk_queue::chunk * cur;
+	std::thread hasher;
+	bool matched;
+
+
+public:
+	/// Check against the hashes in the specified metadata, which has to outlive this, hashing depth chunks of chunk_size at a time.
+	content_verifier(const archive_metadata & meta, std::size_t depth, std::size_t chunk_size);
+	/// Stops the hasher if verify() wasn't called.
+	~content_verifier();
+	content_verifier(const content_verifier &) = delete;
+	content_verifier(content_verifier &&)      = delete;
+
+	/// Return value: whether the metadata has any hashes to check against.
+	static bool applies_to(const archive_metadata & meta);
+
+	/// Return value: a buffer of chunk_size() to decode into, the same one until some of it's handed over with consume().
+	char * buffer();
+	std::size_t chunk_size() const;
+
+	/// Hash the first len bytes of buffer().
+	void consume(std::size_t len);
+
+	/// Wait for everything handed over to be hashed.
+	///
+	/// Return value: 0 if it matches the metadata, E_BAD_DATA otherwise.
+	int verify();
+};
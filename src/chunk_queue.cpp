@@ -0,0 +1,98 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "chunk_queue.hpp"
+#include <algorithm>
+
+
+chunk_queue::chunk_queue(std::size_t depth, std::size_t chunk_size)
+      : capacity(chunk_size), buffers(std::max<std::size_t>(depth, 1)), slots(buffers.size()), filled(0), handed(0), released(0), lent(false), done(false),
+        stopping(false), err(0) {
+	for(std::size_t i = 0; i != buffers.size(); ++i) {
+		buffers[i] = std::make_unique<char[]>(capacity);
+		slots[i]   = {buffers[i].get(), 0, 0};
+	}
+}
+
+std::size_t chunk_queue::chunk_size() const {
+	return capacity;
+}
+
+chunk_queue::chunk * chunk_queue::acquire() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] { return stopping || filled - released < slots.size(); });
+	if(stopping)
+		return nullptr;
+
+	auto & ret   = slots[filled % slots.size()];
+	ret.size     = 0;
+	ret.progress = 0;
+	return &ret;
+}
+
+void chunk_queue::publish() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		++filled;
+	}
+	changed.notify_all();
+}
+
+void chunk_queue::finish(int error) {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		done = true;
+		err  = error;
+	}
+	changed.notify_all();
+}
+
+std::optional<chunk_queue::chunk> chunk_queue::next() {
+	std::unique_lock<std::mutex> guard(lock);
+	if(lent) {
+		lent = false;
+		++released;
+		changed.notify_all();
+	}
+
+	changed.wait(guard, [&] { return filled != handed || done; });
+	if(filled != handed) {
+		lent = true;
+		return slots[handed++ % slots.size()];
+	}
+
+	if(err)
+		return std::nullopt;
+	return chunk{nullptr, 0, 0};
+}
+
+void chunk_queue::stop() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+}
+
+int chunk_queue::error() const {
+	return err;
+}
@@ -0,0 +1,86 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+
+/// A bounded pool of buffers, filled in order by one producer thread and handed to one consumer.
+///
+/// The producer waits when the consumer's depth chunks behind, so memory use stays at depth * chunk_size.
+class chunk_queue {
+public:
+	struct chunk {
+		char * data;
+		std::size_t size;
+		/// Whatever the producer got through to fill it, for reporting progress.
+		std::uint64_t progress;
+	};
+
+private:
+	std::size_t capacity;
+	std::vector<std::unique_ptr<char[]>> buffers;
+	std::vector<chunk> slots;
+	std::mutex lock;
+	std::condition_variable changed;
+	/// Slots published, handed out, and given back; slot i is slots[i % slots.size()].
+	std::uint64_t filled, handed, released;
+	bool lent, done, stopping;
+	int err;
+
+
+public:
+	chunk_queue(std::size_t depth, std::size_t chunk_size);
+	chunk_queue(const chunk_queue &) = delete;
+	chunk_queue(chunk_queue &&)      = delete;
+
+	std::size_t chunk_size() const;
+
+	/// Producer: wait for the next chunk to fill, emptied, once the consumer's given enough back.
+	///
+	/// Return value: the chunk, to fill up to chunk_size(), or nullptr if the consumer's stopped.
+	chunk * acquire();
+
+	/// Producer: hand the acquired chunk over.
+	void publish();
+
+	/// Producer: there'll be nothing more, because of the specified error, or 0 at the end.
+	void finish(int error);
+
+	/// Consumer: wait for the next chunk. The previously returned one is recycled.
+	///
+	/// Return value: the chunk, size 0 at the end, or nullopt if the producer failed, see error().
+	std::optional<chunk> next();
+
+	/// Consumer: don't want any more; acquire() returns nullptr from now on.
+	void stop();
+
+	/// Return value: what the producer finished with, once next() returned nullopt.
+	int error() const;
+};
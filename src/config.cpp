@@ -23,39 +23,346 @@
 #include "config.hpp"
 #include "util.hpp"
 #include <algorithm>
+#include <filesystem>
 #include <fstream>
+#include <iterator>
+#include <lz4.h>
+#include <lzma.h>
 #include <map>
 #include <nlohmann/json.hpp>
+#include <zlib.h>
 #include <zstd/zstd.h>
 
 
+static const char * const strategy_names[] = {"", "fast", "dfast", "greedy", "lazy", "lazy2", "btlazy2", "btopt", "btultra", "btultra2"};
+static const char * const autotune_goal_names[] = {"off", "speed", "ratio", "time"};
+
+
+template <class T>
+static bool read_key(const nlohmann::json & cfg, const char * key, T & into) {
+	try {
+		if(auto itr = cfg.find(key); itr != cfg.end()) {
+			into = itr->template get<T>();
+			return true;
+		}
+	} catch(...) {
+	}
+	return false;
+}
+
+template <class T>
+static bool read_key(const nlohmann::json & cfg, const char * key, std::optional<T> & into) {
+	T val;
+	if(!read_key(cfg, key, val))
+		return false;
+	into = val;
+	return true;
+}
+
+static compression_parameters read_parameters(const nlohmann::json & from) {
+	compression_parameters ret;
+	if(read_key(from, "level", ret.level))
+		ret.level = std::clamp(*ret.level, ZSTD_minCLevel(), ZSTD_maxCLevel());
+	if(std::string strategy; read_key(from, "strategy", strategy)) {
+		if(auto itr = std::find(std::begin(strategy_names) + 1, std::end(strategy_names), strategy); itr != std::end(strategy_names))
+			ret.strategy = itr - std::begin(strategy_names);
+	} else
+		read_key(from, "strategy", ret.strategy);
+	read_key(from, "window‐log", ret.window_log);
+	read_key(from, "workers", ret.workers);
+	read_key(from, "rsyncable", ret.rsyncable);
+	read_key(from, "dictionary", ret.dictionary);
+	read_key(from, "patch‐from", ret.patch_from);
+	return ret;
+}
+
+static nlohmann::ordered_json write_parameters(const compression_rule & rule) {
+	const auto & params = rule.parameters;
+
+	nlohmann::ordered_json out{{"match", rule.match}};
+	if(params.level)
+		out["level"] = *params.level;
+	if(params.strategy) {
+		if(*params.strategy > 0 && *params.strategy < static_cast<int>(std::size(strategy_names)))
+			out["strategy"] = strategy_names[*params.strategy];
+		else
+			out["strategy"] = *params.strategy;
+	}
+	if(params.window_log)
+		out["window‐log"] = *params.window_log;
+	if(params.workers)
+		out["workers"] = *params.workers;
+	if(params.rsyncable)
+		out["rsyncable"] = *params.rsyncable;
+	if(!params.dictionary.empty())
+		out["dictionary"] = params.dictionary;
+	if(!params.patch_from.empty())
+		out["patch‐from"] = params.patch_from;
+	return out;
+}
+
+static bool glob_match(std::string_view pattern, std::string_view str) {
+	std::size_t p{}, s{}, star_p = std::string_view::npos, star_s{};
+	while(s != str.size()) {
+		if(p != pattern.size() && (pattern[p] == '?' || pattern[p] == str[s])) {
+			++p;
+			++s;
+		} else if(p != pattern.size() && pattern[p] == '*') {
+			star_p = p++;
+			star_s = s;
+		} else if(star_p != std::string_view::npos) {
+			p = star_p + 1;
+			s = ++star_s;
+		} else
+			return false;
+	}
+	while(p != pattern.size() && pattern[p] == '*')
+		++p;
+	return p == pattern.size();
+}
+
+
+compression_policy::compression_policy(const std::vector<compression_rule> & rules) {
+	for(std::size_t i = 0; i != rules.size(); ++i)
+		for(auto && pattern : rules[i].match) {
+			auto lpattern = lowercase(pattern);
+			if(lpattern.starts_with("*.") && lpattern.find_first_of("*?", 2) == std::string::npos)
+				by_extension.emplace(lpattern.substr(2), i);
+			else
+				globs.emplace_back(std::move(lpattern), i);
+		}
+}
+
+std::optional<std::size_t> compression_policy::match(std::string_view fname) const {
+	const auto name = lowercase(fname.substr(fname.find_last_of("\\/") + 1));
+
+	std::optional<std::size_t> ret;
+	for(auto dot = name.find('.'); dot != std::string::npos; dot = name.find('.', dot + 1))
+		if(auto itr = by_extension.find(name.substr(dot + 1)); itr != by_extension.end() && (!ret || itr->second < *ret))
+			ret = itr->second;
+
+	for(auto && [pattern, rule] : globs) {
+		if(ret && rule >= *ret)
+			break;
+		if(glob_match(pattern, name))
+			return rule;
+	}
+	return ret;
+}
+
+
 configuration::configuration() {
 	std::ifstream in(config_file());
 	if(in.is_open()) {
-		try {
-			auto cfg          = nlohmann::json::parse(in, nullptr, false);
-			auto clvl         = cfg["compression‐level"].template get<std::size_t>();
-			compression_level = std::min(clvl, static_cast<std::size_t>(ZSTD_maxCLevel()));
-		} catch(...) {
+		auto cfg = nlohmann::json::parse(in, nullptr, false);
+		if(!cfg.is_object()) {
+			rewritable = false;
+			return;
 		}
+
+		read_key(cfg, "compression‐level", compression_level);
+		compression_level = std::min(compression_level, static_cast<std::size_t>(ZSTD_maxCLevel()));
+		if(std::string goal; read_key(cfg, "autotune", goal))
+			if(auto itr = std::find(std::begin(autotune_goal_names), std::end(autotune_goal_names), goal); itr != std::end(autotune_goal_names))
+				autotune = static_cast<autotune_goal>(itr - std::begin(autotune_goal_names));
+		read_key(cfg, "autotune‐speed", autotune_speed);
+		read_key(cfg, "autotune‐ratio", autotune_ratio);
+		read_key(cfg, "disk‐speed", disk_speed);
+		read_key(cfg, "calibrate", calibrate);
+		read_key(cfg, "incompressible‐threshold", incompressible_threshold);
+		read_key(cfg, "rsyncable", rsyncable);
+		read_key(cfg, "patch‐from", patch_from);
+		read_key(cfg, "frame‐size", frame_size);
+		read_key(cfg, "flush‐interval‐size", flush_interval_size);
+		read_key(cfg, "flush‐interval‐time", flush_interval_time);
+		read_key(cfg, "one‐shot‐threshold", one_shot_threshold);
+		read_key(cfg, "readahead‐depth", readahead_depth);
+		read_key(cfg, "readahead‐buffer‐min", readahead_buffer_min);
+		read_key(cfg, "readahead‐buffer‐max", readahead_buffer_max);
+		readahead_buffer_min = std::clamp<std::size_t>(readahead_buffer_min, 1, 16);
+		readahead_buffer_max = std::clamp<std::size_t>(readahead_buffer_max, readahead_buffer_min, 16);
+		read_key(cfg, "thread‐budget", thread_budget);
+		read_key(cfg, "memory‐budget", memory_budget);
+		read_key(cfg, "process‐memory‐budget", process_memory_budget);
+		read_key(cfg, "transcode", transcode);
+		read_key(cfg, "deduplicate", deduplicate);
+		read_key(cfg, "sha256", sha256);
+		read_key(cfg, "tar‐members", tar_members);
+		read_key(cfg, "parallel‐extraction", parallel_extraction);
+		read_key(cfg, "sparse‐extraction", sparse_extraction);
+
+		if(auto rules = cfg.find("compression‐rules"); rules != cfg.end() && rules->is_array())
+			for(auto && rule : *rules) {
+				if(!rule.is_object())
+					continue;
+				compression_rule crule;
+				read_key(rule, "match", crule.match);
+				crule.parameters = read_parameters(rule);
+				compression_rules.emplace_back(std::move(crule));
+			}
+		policy = compression_policy(compression_rules);
 	}
 }
 
-configuration::~configuration() {
-	std::size_t max_clevel = ZSTD_maxCLevel();
-	compression_level      = std::min(compression_level, max_clevel);
+const compression_parameters * configuration::rule_for(const char * fname) const {
+	if(fname)
+		if(const auto rule = policy.match(fname))
+			return &compression_rules[*rule].parameters;
+	return nullptr;
+}
 
-	std::ofstream out(config_file());
+compression_parameters configuration::parameters_for(const char * fname) const {
+	compression_parameters ret;
+	if(const auto rule = rule_for(fname))
+		ret = *rule;
+
+	if(!ret.level)
+		ret.level = compression_level;
+	if(!ret.rsyncable)
+		ret.rsyncable = rsyncable;
+	if(ret.patch_from.empty())
+		ret.patch_from = patch_from;
+	return ret;
+}
+
+std::string configuration::dictionary_for(unsigned int dict_id) const {
+	for(auto && rule : compression_rules) {
+		if(rule.parameters.dictionary.empty())
+			continue;
+
+		std::ifstream dict(rule.parameters.dictionary, std::ios::binary);
+		char header[8];  // magic + ID
+		if(!dict.read(header, sizeof(header)) || ZSTD_getDictID_fromDict(header, sizeof(header)) != dict_id)
+			continue;
+
+		dict.seekg(0);
+		return {std::istreambuf_iterator<char>{dict}, {}};
+	}
+	return {};
+}
+
+bool configuration::save() const {
+	const std::size_t max_clevel = ZSTD_maxCLevel();
+
+	auto rules = nlohmann::ordered_json::array();
+	for(auto && rule : compression_rules)
+		rules.emplace_back(write_parameters(rule));
+
+	const auto path = config_file();
+	const auto temp = path + ".new";
+	std::ofstream out(temp);
 	out << std::setw(2);
 	out << nlohmann::ordered_json{
-	    {"compression‐level", compression_level},
+	    {"compression‐level", std::min(compression_level, max_clevel)},
 	    {"compression-level-comment",
 	     "Integer between 0 (store) and " + std::to_string(max_clevel) + " (ultra). Values ≥20 should be used with caution, as they require more memory."},
+	    {"autotune", autotune_goal_names[static_cast<std::size_t>(autotune)]},
+	    {"autotune‐speed", autotune_speed},
+	    {"autotune‐ratio", autotune_ratio},
+	    {"disk‐speed", disk_speed},
+	    {"autotune-comment",
+	     "Pick the level (and strategy) instead when packing more than 64 MiB, by trial-compressing samples of the input with a range of them first: "
+	     "\"off\" to use the one above, \"speed\" for the best ratio packing at least autotune‐speed MB/s, \"ratio\" for the fastest "
+	     "packing to at most 1/autotune‐ratio of the size, or \"time\" for the least time reading and writing at disk‐speed MB/s. "
+	     "Levels set by compression rules are kept."},
+	    {"calibrate", calibrate},
+	    {"calibrate-comment",
+	     "true to benchmark this machine the next time this file is opened from Total Commander (or on running "
+	     "\"rundll32 totalcmd-zstd.wcx64,Calibrate\"), setting disk‐speed to how fast the temporary directory takes writes, "
+	     "autotune‐speed to match it, and the compression level to the one taking the least time at that speed. Set back to false once done."},
+	    {"incompressible‐threshold", incompressible_threshold},
+	    {"incompressible-threshold-comment",
+	     "Bits of entropy per byte (0-8) at which an already-compressed region (JPEG, MP4, nested archives) is stored instead of compressed. Set above 8 to disable."},
+	    {"rsyncable", rsyncable},
+	    {"rsyncable-comment",
+	     "true to periodically resynchronise the compressed output with the input, so that small changes to a file make small changes to the archive, "
+	     "for deduplicating backups. Costs about 1% in size; always compresses on a worker thread."},
+	    {"patch‐from", patch_from},
+	    {"patch-from-comment",
+	     "Path to a reference file (e.g. the previous build) to compress against, for small delta archives. The path is recorded in the archive, "
+	     "and has to be the same file when unpacking."},
+	    {"frame‐size", frame_size},
+	    {"frame-size-comment",
+	     "Size in MiB after which the data is continued in a new frame; 0 (the default) for no limit. While extracting, a .zstd-resume file "
+	     "is kept next to the output, and extracting there again after a failure, cancellation, or crash picks up from the last whole frame; "
+	     "e.g. 1024 gives large archives somewhere to pick up from."},
+	    {"flush‐interval‐size", flush_interval_size},
+	    {"flush‐interval‐time", flush_interval_time},
+	    {"flush-interval-comment",
+	     "When packing into memory for Total Commander (PackToMem), flush the compressed output once this many KiB have been taken, "
+	     "or this many milliseconds have passed, since the last flush, so whatever's reading it gets a steady stream; 0 for never. "
+	     "Each flush cuts short a worker's job, so intervals much below a few MiB cost ratio and parallelism."},
+	    {"one‐shot‐threshold", one_shot_threshold},
+	    {"one-shot-threshold-comment",
+	     "Size in MiB up to which files are packed, and archives unpacked, whole in memory instead of streamed; faster for many small files. 0 to always stream."},
+	    {"readahead‐depth", readahead_depth},
+	    {"readahead-depth-comment", "How many reads to keep in flight when unpacking. Raise for high-latency storage like network shares."},
+	    {"readahead‐buffer‐min", readahead_buffer_min},
+	    {"readahead‐buffer‐max", readahead_buffer_max},
+	    {"readahead-buffer-comment",
+	     "Size of each read when unpacking, in MiB, between 1 and 16. Reads start at the minimum and grow towards the maximum while decoding has to wait for them, "
+	     "then shrink back towards the minimum while they're ready ahead of it."},
+	    {"thread‐budget", thread_budget},
+	    {"thread-budget-comment",
+	     "How many threads all packing and unpacking running at the same time may use between them, split evenly; 0 for one per core. "
+	     "Applies after restarting Total Commander."},
+	    {"memory‐budget", memory_budget},
+	    {"process‐memory‐budget", process_memory_budget},
+	    {"memory-budget-comment",
+	     "Memory in MiB each packing or unpacking may use, and all of them running at the same time may use between them; 0 for no limit. "
+	     "Packing lowers the worker count, then the level, then the window size to fit; "
+	     "unpacking refuses archives with windows that don't fit with \"Not enough memory\". Applies after restarting Total Commander."},
+	    {"transcode", transcode},
+	    {"transcode-comment",
+	     "true to pack .gz, .xz and .lz4 files packed on their own as what they contain, named without that extension, "
+	     "decompressing them on a separate thread as they're packed, to convert them to zstd in one pass."},
+	    {"deduplicate", deduplicate},
+	    {"deduplicate-comment",
+	     "true to pack files with the same content as one before them in a .tar.zst or .tzst as hard links to it instead, "
+	     "for build outputs with many copies. Other tar tools extract those as links; extracting them here copies the file linked to, "
+	     "reading it out of the archive again if it wasn't extracted."},
+	    {"sha256", sha256},
+	    {"sha256-comment",
+	     "true to record a SHA-256 of the content in new archives, alongside the XXH64 always recorded, for proof the extracted files match. "
+	     "Both are checked as they're extracted or tested, on a separate thread; slower to pack."},
+	    {"tar‐members", tar_members},
+	    {"tar-members-comment",
+	     "true to show the files in .tar.zst and .tzst archives directly, instead of the .tar inside, "
+	     "so they can be extracted without Total Commander unpacking the whole .tar first."},
+	    {"parallel‐extraction", parallel_extraction},
+	    {"parallel-extraction-comment",
+	     "true to write small files out on a pool of threads (the thread budget's share) when extracting them from tarballs as above, "
+	     "for trees of many small files. Errors are reported at the end, for the first file that failed."},
+	    {"sparse‐extraction", sparse_extraction},
+	    {"sparse-extraction-comment",
+	     "true to extract files as sparse files, leaving runs of zeros of 64 KiB and up unallocated instead of writing them, "
+	     "for disk images and databases. Packing always skips reading the unallocated parts of sparse files."},
+	    {"compression‐rules", rules},
+	    {"compression-rules-comment",
+	     "Per-file overrides, first matching wins. Each is {\"match\": [\"*.log\", \"access?.txt\"]} with any of \"level\" (" +
+	         std::to_string(ZSTD_minCLevel()) + " to " + std::to_string(max_clevel) +
+	         "), \"strategy\" (fast, dfast, greedy, lazy, lazy2, btlazy2, btopt, btultra, btultra2), \"window‐log\" (" +
+	         std::to_string(ZSTD_WINDOWLOG_MIN) + " to " + std::to_string(ZSTD_WINDOWLOG_MAX) +
+	         "), \"workers\" (compression threads, at most the thread budget's share), \"rsyncable\" (as above), "
+	         "\"dictionary\" (path to a dictionary from zstd --train), \"patch‐from\" (as above)."},
 	    {"", ""},
 	    {"totalcmd-zstd", "version " TOTALCMD_ZSTD_VERSION ", found at https://github.com/nabijaczleweli/totalcmd-zstd"},
 	    {"zstd", "version " ZSTD_VERSION_STRING ", found at https://github.com/facebook/zstd"},
 	    {"json", "version " JSON_VERSION ", found at https://github.com/nlohmann/json"},
 	    {"whereami-cpp", "version " WHEREAMI_CPP_VERSION ", found at https://github.com/nabijaczleweli/whereami-cpp"},
 	    {"inih", "revision " INIH_VERSION ", found at https://github.com/benhoyt/inih"},
+	    {"zlib", "version " ZLIB_VERSION ", found at https://github.com/madler/zlib"},
+	    {"xz", "version " LZMA_VERSION_STRING ", found at https://github.com/tukaani-project/xz"},
+	    {"lz4", "version " LZ4_VERSION_STRING ", found at https://github.com/lz4/lz4"},
 	};
+	out.close();
+
+	std::error_code ec;
+	if(out)
+		std::filesystem::rename(temp, path, ec);
+	if(!out || ec) {
+		std::filesystem::remove(temp, ec);
+		return false;
+	}
+	return true;
 }
@@ -24,11 +24,114 @@
 
 
 #include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 
+/// A full set of compression settings. Unset ones fall back to the global configuration, then to zstd's defaults.
+struct compression_parameters {
+	std::optional<int> level;
+	/// One of ZSTD_strategy.
+	std::optional<int> strategy;
+	std::optional<int> window_log;
+	std::optional<int> workers;
+	/// Resynchronise the output with the input periodically, so small changes in the input make small changes in the output. Implies workers.
+	std::optional<bool> rsyncable;
+	/// Path to a dictionary trained with zstd --train.
+	std::string dictionary;
+	/// Path to a reference file to compress against, like zstd --patch-from.
+	std::string patch_from;
+};
+
+struct compression_rule {
+	/// Globs (* and ?) matched case-insensitively against the file name.
+	std::vector<std::string> match;
+	compression_parameters parameters;
+};
+
+/// compression_rules compiled for lookup: "*.ext" patterns are hashed by extension, the rest are globbed through in order.
+class compression_policy {
+private:
+	std::unordered_map<std::string, std::size_t> by_extension;
+	std::vector<std::pair<std::string, std::size_t>> globs;
+
+
+public:
+	compression_policy() = default;
+	compression_policy(const std::vector<compression_rule> & rules);
+
+	/// Return value: index of the first rule matching the specified file name, if any.
+	std::optional<std::size_t> match(std::string_view fname) const;
+};
+
+/// What the level is picked for before packing, by trial-compressing samples of the input: off to use the configured one,
+/// the best ratio at autotune_speed, the fastest at autotune_ratio, or the least time reading and writing at disk_speed.
+enum class autotune_goal { off, speed, ratio, time };
+
 struct configuration {
 	std::size_t compression_level = 1;
+	autotune_goal autotune = autotune_goal::off;
+	/// In MB/s (10⁶ bytes), of the input.
+	double autotune_speed = 100, disk_speed = 200;
+	double autotune_ratio = 3;
+	/// Benchmark this machine the next time the configuration's opened, and write the recommended settings in.
+	bool calibrate = false;
+	/// Regions whose sampled entropy (in bits per byte) is at least this are stored with the cheapest settings instead of compressed.
+	double incompressible_threshold = 7.9;
+	bool rsyncable = false;
+	std::string patch_from;
+	/// In MiB; frames are ended once this much has been packed into them, for extraction to pick up again from, 0 for no limit.
+	std::size_t frame_size = 0;
+	/// When packing into memory: flush what's been compressed once this many KiB have been taken, or this many ms have passed, since the last; 0 for never.
+	std::size_t flush_interval_size = 0, flush_interval_time = 0;
+	/// In MiB; files and archives up to this size are read whole and (de)compressed in one go.
+	std::size_t one_shot_threshold = 16;
+	/// Reads kept in flight when unpacking.
+	std::size_t readahead_depth = 4;
+	/// In MiB; reads grow from min to max while the decoder ends up waiting for them, and shrink back while they're ready ahead of it.
+	std::size_t readahead_buffer_min = 1, readahead_buffer_max = 16;
+	/// Worker threads shared between all operations running at once; 0 for one per core.
+	std::size_t thread_budget = 0;
+	/// In MiB, 0 for no limit; compression settings are lowered, and windows too large to decode refused, to stay under them.
+	std::size_t memory_budget = 0, process_memory_budget = 0;
+	/// Pack gzip, xz and lz4 files as what they contain, instead of as they are.
+	bool transcode = false;
+	/// Pack files with the same content as an earlier one in a tarball as hard links to it.
+	bool deduplicate = false;
+	/// Record a SHA-256 of the content alongside the XXH64, both checked on extraction.
+	bool sha256 = false;
+	/// List the members of tarballs, instead of the tarball inside.
+	bool tar_members = false;
+	/// Write small members out on a pool of threads when extracting them.
+	bool parallel_extraction = false;
+	/// Leave runs of zeros out of extracted files, as holes in sparse files.
+	bool sparse_extraction = false;
+	std::vector<compression_rule> compression_rules;
 
+	/// Whether the file was missing or read, as opposed to unreadable, so save() can't lose what the user wrote there.
+	bool rewritable = true;
+
+	/// Read once per operation, and passed down to everything that operation does.
 	configuration();
-	~configuration();
+
+	/// Write the settings out, with a comment on each, through a temporary file, so they're never seen half-written.
+	///
+	/// Return value: whether it was replaced.
+	bool save() const;
+
+	/// Return value: the settings of the first rule matching the specified file name, if any, as configured.
+	const compression_parameters * rule_for(const char * fname) const;
+
+	/// Return value: the settings of the first rule matching the specified file name, filled out with the global ones.
+	compression_parameters parameters_for(const char * fname) const;
+
+	/// Return value: contents of the configured dictionary with the specified ID, or empty if none.
+	std::string dictionary_for(unsigned int dict_id) const;
+
+private:
+	compression_policy policy;
 };
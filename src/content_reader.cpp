@@ -0,0 +1,109 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "content_reader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <streambuf>
+
+
+namespace {
+	/// Fills chunks with whatever's written into it; writes fail once the consumer's stopped.
+	class chunk_queue_streambuf : public std::streambuf {
+	private:
+		chunk_queue & queue;
+		chunk_queue::chunk * cur = nullptr;
+
+	public:
+		chunk_queue_streambuf(chunk_queue & q) : queue(q) {}
+
+		/// Hand the last, partial, chunk over.
+		void flush_out() {
+			if(cur && cur->size)
+				queue.publish();
+			cur = nullptr;
+		}
+
+	protected:
+		std::streamsize xsputn(const char_type * data, std::streamsize count) override {
+			std::streamsize written = 0;
+			while(written != count) {
+				if(!cur && !(cur = queue.acquire()))
+					break;
+
+				const auto len = std::min<std::size_t>(count - written, queue.chunk_size() - cur->size);
+				std::memcpy(cur->data + cur->size, data + written, len);
+				cur->size += len;
+				written += len;
+				if(cur->size == queue.chunk_size()) {
+					queue.publish();
+					cur = nullptr;
+				}
+			}
+			return written;
+		}
+
+		int_type overflow(int_type c) override {
+			if(traits_type::eq_int_type(c, traits_type::eof()))
+				return traits_type::not_eof(c);
+			const auto ch = traits_type::to_char_type(c);
+			return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+		}
+	};
+}
+
+
+content_reader::content_reader(std::function<int(std::ostream &)> decode, std::size_t depth, std::size_t chunk_size)
+      : decoded(depth, chunk_size), cur{nullptr, 0, 0}, pos(0) {
+	memory.reserve(depth * chunk_size);
+	decoder = std::thread([this, decode = std::move(decode)] {
+		chunk_queue_streambuf buf(decoded);
+		std::ostream out(&buf);
+		const auto error = decode(out);
+		buf.flush_out();
+		decoded.finish(error);
+	});
+}
+
+content_reader::~content_reader() {
+	decoded.stop();
+	decoder.join();
+}
+
+std::optional<std::pair<const char *, std::size_t>> content_reader::next(std::size_t len) {
+	if(pos == cur.size) {
+		const auto chunk = decoded.next();
+		if(!chunk)
+			return std::nullopt;
+		cur = *chunk;
+		pos = 0;
+	}
+
+	const auto n   = std::min(len, cur.size - pos);
+	const auto ret = std::make_pair(static_cast<const char *>(cur.data + pos), n);
+	pos += n;
+	return ret;
+}
+
+int content_reader::error() const {
+	return decoded.error();
+}
@@ -0,0 +1,61 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include "chunk_queue.hpp"
+#include "memory_budget.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <thread>
+#include <utility>
+
+
+/// Reads content as it's decoded on a thread of its own, which only gets as far ahead of what's been read as its buffers go,
+/// so reading the start of a large archive doesn't decode, or read, the rest.
+class content_reader {
+private:
+	memory_reservation memory;
+	chunk_queue decoded;
+	std::thread decoder;
+	chunk_queue::chunk cur;
+	std::size_t pos;
+
+
+public:
+	/// Start decoding on a thread of its own with the specified function, which writes the whole content into the stream and returns an E_* error or 0,
+	/// at most depth chunks of chunk_size ahead of what's been read.
+	content_reader(std::function<int(std::ostream &)> decode, std::size_t depth, std::size_t chunk_size);
+	/// Stops the decoder if it's not done yet.
+	~content_reader();
+	content_reader(const content_reader &) = delete;
+	content_reader(content_reader &&)      = delete;
+
+	/// Return value: up to len (> 0) of the next bytes, valid until the next call, empty at the end, or nullopt if decoding failed, see error().
+	std::optional<std::pair<const char *, std::size_t>> next(std::size_t len);
+
+	/// Return value: what decoding failed with, once next() returned nullopt.
+	int error() const;
+};
@@ -0,0 +1,103 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "dedup.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <utility>
+#define XXH_STATIC_LINKING_ONLY
+#include <zstd/common/xxhash.h>
+
+
+static const constexpr std::size_t read_size = 1024 * 1024;
+
+
+static std::optional<std::uint64_t> hash_file(const std::string & path) {
+	std::ifstream in(path, std::ios::binary);
+	if(!in)
+		return std::nullopt;
+
+	auto buffer = std::make_unique<char[]>(read_size);
+	XXH64_state_t state;
+	XXH64_reset(&state, 0);
+	while(in.read(buffer.get(), read_size) || in.gcount())
+		XXH64_update(&state, buffer.get(), in.gcount());
+	if(in.bad())
+		return std::nullopt;
+	return XXH64_digest(&state);
+}
+
+static bool same_content(const std::string & lhs_path, const std::string & rhs_path) {
+	std::ifstream lhs(lhs_path, std::ios::binary), rhs(rhs_path, std::ios::binary);
+	if(!lhs || !rhs)
+		return false;
+
+	auto lhs_buffer = std::make_unique<char[]>(read_size), rhs_buffer = std::make_unique<char[]>(read_size);
+	for(;;) {
+		lhs.read(lhs_buffer.get(), read_size);
+		rhs.read(rhs_buffer.get(), read_size);
+		if(lhs.gcount() != rhs.gcount() || std::memcmp(lhs_buffer.get(), rhs_buffer.get(), lhs.gcount()))
+			return false;
+		if(!lhs.gcount())
+			return !lhs.bad() && !rhs.bad();
+	}
+}
+
+
+std::vector<std::optional<std::size_t>> find_duplicates(const std::vector<std::string> & paths, const std::vector<std::optional<std::uint64_t>> & sizes,
+                                                        const worker_share & share) {
+	std::vector<std::optional<std::size_t>> ret(paths.size());
+
+	// Only files sharing their size with another can be the same; most don't, and are never read
+	std::map<std::uint64_t, std::vector<std::size_t>> by_size;
+	for(std::size_t i = 0; i != paths.size(); ++i)
+		if(sizes[i] && *sizes[i] >= min_duplicate_size)
+			by_size[*sizes[i]].emplace_back(i);
+
+	std::vector<std::size_t> candidates;
+	for(auto && [size, files] : by_size)
+		if(files.size() > 1)
+			candidates.insert(candidates.end(), files.begin(), files.end());
+	std::sort(candidates.begin(), candidates.end());
+
+	std::vector<std::optional<std::uint64_t>> hashes(paths.size());
+	parallel_for(share, candidates.size(), [&](std::size_t i) { hashes[candidates[i]] = hash_file(paths[candidates[i]]); });
+
+	// The first of each size and hash is kept, later ones are checked against it; a hash collision only ever costs a missed link
+	std::map<std::pair<std::uint64_t, std::uint64_t>, std::size_t> firsts;
+	std::vector<std::pair<std::size_t, std::size_t>> pairs;
+	for(auto i : candidates)
+		if(hashes[i]) {
+			if(const auto [itr, inserted] = firsts.emplace(std::pair{*sizes[i], *hashes[i]}, i); !inserted)
+				pairs.emplace_back(i, itr->second);
+		}
+
+	parallel_for(share, pairs.size(), [&](std::size_t i) {
+		if(same_content(paths[pairs[i].first], paths[pairs[i].second]))
+			ret[pairs[i].first] = pairs[i].second;
+	});
+	return ret;
+}
@@ -0,0 +1,43 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include "worker_pool.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+
+/// Files smaller than this aren't worth linking to: the link's header is about as big, and zstd's window reaches copies that close anyway.
+static const constexpr std::uint64_t min_duplicate_size = 4096;
+
+
+/// Find files with the same content among the specified ones, nullopt sizes for ones to leave out, like directories.
+///
+/// Files are grouped by size, then XXH64 hashed and compared byte-for-byte, both on the specified operation's share of threads.
+///
+/// Return value: for each file, the index of the first one before it with the same content, if any.
+std::vector<std::optional<std::size_t>> find_duplicates(const std::vector<std::string> & paths, const std::vector<std::optional<std::uint64_t>> & sizes,
+                                                        const worker_share & share);
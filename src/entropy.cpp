@@ -0,0 +1,56 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "entropy.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+
+double estimate_entropy(const void * data, std::size_t len, std::size_t sample_size) {
+	constexpr std::size_t run_len = 64;
+
+	if(len == 0)
+		return 0;
+
+	const auto bytes  = static_cast<const unsigned char *>(data);
+	const auto runs   = std::max<std::size_t>(std::min(len, sample_size) / run_len, 1);
+	const auto stride = len / runs;
+
+	std::uint32_t histogram[256]{};
+	std::size_t sampled{};
+	for(std::size_t run = 0; run != runs; ++run) {
+		const auto start = run * stride;
+		const auto end   = std::min(start + run_len, len);
+		for(auto i = start; i != end; ++i)
+			++histogram[bytes[i]];
+		sampled += end - start;
+	}
+
+	double entropy{};
+	for(auto count : histogram)
+		if(count) {
+			const auto p = static_cast<double>(count) / sampled;
+			entropy -= p * std::log2(p);
+		}
+	return entropy;
+}
@@ -0,0 +1,61 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "memory_budget.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <utility>
+
+
+static std::atomic<std::size_t> total_reserved;
+
+/// Return value: {per-operation, process-wide} budgets in bytes, unlimited if 0 in the configuration.
+static std::pair<std::size_t, std::size_t> budgets() {
+	static const auto ret = [] {
+		const configuration cfg;
+		const auto bytes = [](std::size_t mib) {
+			return mib && mib < std::numeric_limits<std::size_t>::max() / (1024 * 1024) ? mib * 1024 * 1024 : std::numeric_limits<std::size_t>::max();
+		};
+		return std::pair{bytes(cfg.memory_budget), bytes(cfg.process_memory_budget)};
+	}();
+	return ret;
+}
+
+
+memory_reservation::memory_reservation() : reserved(0) {}
+
+memory_reservation::~memory_reservation() {
+	total_reserved -= reserved;
+}
+
+std::size_t memory_reservation::available() const {
+	const auto [operation, process] = budgets();
+	const auto others               = total_reserved - reserved;
+	return std::min(operation, process > others ? process - others : 0);
+}
+
+void memory_reservation::reserve(std::size_t bytes) {
+	total_reserved += bytes - reserved;
+	reserved = bytes;
+}
@@ -0,0 +1,49 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstddef>
+
+
+/// A reservation against the memory budgets, held for the duration of one operation.
+///
+/// The budgets are best-effort: operations size themselves to what's available whenever they're (re)configured,
+/// and never wait for other ones to finish.
+class memory_reservation {
+private:
+	std::size_t reserved;
+
+
+public:
+	memory_reservation();
+	~memory_reservation();
+	memory_reservation(const memory_reservation &) = delete;
+	memory_reservation(memory_reservation &&)      = delete;
+
+	/// Return value: bytes this operation may use: the per-operation budget, or what other operations left of the process-wide one, if less.
+	std::size_t available() const;
+
+	/// Replace the reservation with the specified amount, whether it fits or not.
+	void reserve(std::size_t bytes);
+};
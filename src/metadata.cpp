@@ -0,0 +1,115 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "metadata.hpp"
+#include "util.hpp"
+#include <cstring>
+#include <fstream>
+#include <nlohmann/json.hpp>
+#include <zstd/zstd.h>
+
+
+std::string archive_metadata::to_frame(std::size_t pad_to) const {
+	nlohmann::ordered_json meta{{"totalcmd‐zstd", TOTALCMD_ZSTD_VERSION}};
+	if(!name.empty())
+		meta["name"] = ansi_to_utf8(name);
+	if(mtime)
+		meta["mtime"] = mtime;
+	if(content_size)
+		meta["size"] = *content_size;
+	if(frame_count)
+		meta["frames"] = *frame_count;
+	if(tar_trailer)
+		meta["tar‐trailer"] = *tar_trailer;
+	if(content_xxh64)
+		meta["xxh64"] = *content_xxh64;
+	if(!content_sha256.empty())
+		meta["sha256"] = content_sha256;
+	if(!patch_from.empty()) {
+		meta["patch‐from"]       = ansi_to_utf8(patch_from);
+		meta["patch‐from‐size"]  = patch_from_size;
+		meta["patch‐from‐xxh64"] = patch_from_hash;
+	}
+	auto payload = meta.dump();
+	if(pad_to > ZSTD_SKIPPABLEHEADERSIZE + payload.size())
+		payload.resize(pad_to - ZSTD_SKIPPABLEHEADERSIZE, ' ');
+
+	std::string ret(ZSTD_SKIPPABLEHEADERSIZE + payload.size(), '\0');
+	ret.resize(ZSTD_writeSkippableFrame(ret.data(), ret.size(), payload.data(), payload.size(), metadata_magic_variant));
+	return ret;
+}
+
+std::optional<std::pair<archive_metadata, std::size_t>> archive_metadata::from_frame(const void * buf, std::size_t len) {
+	if(!ZSTD_isSkippableFrame(buf, len))
+		return std::nullopt;
+
+	const auto frame_size = ZSTD_findFrameCompressedSize(buf, len);
+	if(ZSTD_isError(frame_size))
+		return std::nullopt;
+
+	std::string payload(frame_size - ZSTD_SKIPPABLEHEADERSIZE, '\0');
+	unsigned int variant;
+	if(ZSTD_isError(ZSTD_readSkippableFrame(payload.data(), payload.size(), &variant, buf, frame_size)) || variant != metadata_magic_variant)
+		return std::nullopt;
+
+	const auto meta = nlohmann::json::parse(payload, nullptr, false);
+	if(!meta.is_object() || !meta.contains("totalcmd‐zstd"))
+		return std::nullopt;
+
+	archive_metadata ret;
+	try {
+		ret.name  = utf8_to_ansi(meta.value("name", std::string{}));
+		ret.mtime = meta.value("mtime", std::uint64_t{});
+		if(meta.contains("size"))
+			ret.content_size = meta["size"].get<std::uint64_t>();
+		if(meta.contains("frames"))
+			ret.frame_count = meta["frames"].get<std::uint64_t>();
+		if(meta.contains("tar‐trailer"))
+			ret.tar_trailer = meta["tar‐trailer"].get<std::uint64_t>();
+		if(meta.contains("xxh64"))
+			ret.content_xxh64 = meta["xxh64"].get<std::uint64_t>();
+		ret.content_sha256  = meta.value("sha256", std::string{});
+		ret.patch_from      = utf8_to_ansi(meta.value("patch‐from", std::string{}));
+		ret.patch_from_size = meta.value("patch‐from‐size", std::uint64_t{});
+		ret.patch_from_hash = meta.value("patch‐from‐xxh64", std::uint64_t{});
+	} catch(...) {
+		return std::nullopt;
+	}
+	return std::make_pair(std::move(ret), frame_size);
+}
+
+std::optional<std::pair<archive_metadata, std::size_t>> archive_metadata::from_file(const char * fname) {
+	std::ifstream in(fname, std::ios::binary);
+	char header[ZSTD_SKIPPABLEHEADERSIZE];
+	if(!in.read(header, sizeof(header)) || !ZSTD_isSkippableFrame(header, sizeof(header)))
+		return std::nullopt;
+
+	std::uint32_t payload_len;
+	std::memcpy(&payload_len, header + 4, sizeof(payload_len));
+	if(payload_len > max_frame_size - ZSTD_SKIPPABLEHEADERSIZE)
+		return std::nullopt;
+
+	std::string frame(ZSTD_SKIPPABLEHEADERSIZE + payload_len, '\0');
+	if(!in.seekg(0).read(frame.data(), frame.size()))
+		return std::nullopt;
+	return from_frame(frame.data(), frame.size());
+}
@@ -0,0 +1,65 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+
+
+/// Stored as a JSON object in a skippable frame (magic ZSTD_MAGIC_SKIPPABLE_START + metadata_magic_variant) ahead of the data frames,
+/// which stock zstd skips over.
+struct archive_metadata {
+	static const constexpr unsigned int metadata_magic_variant = 0xC;
+	/// Metadata frames larger than this aren't ours, and aren't worth reading to find out.
+	static const constexpr std::size_t max_frame_size = 64 * 1024;
+
+	/// Name of the packed file, without directories.
+	std::string name;
+	/// Modification time of the packed file, in FILETIME units (100ns since 1601-01-01 UTC), 0 if unknown.
+	std::uint64_t mtime = 0;
+	/// Filled in once packing's finished, if the output can be rewritten.
+	std::optional<std::uint64_t> content_size, frame_count;
+	/// For tarballs: offset of the last frame, which holds just the end-of-archive blocks, so members can be appended in its place.
+	std::optional<std::uint64_t> tar_trailer;
+	/// Of the whole content, filled in once packing's finished; SHA-256 as lowercase hex, if "sha256" was set. Checked on extraction.
+	std::optional<std::uint64_t> content_xxh64;
+	std::string content_sha256;
+
+	/// Reference file the data frames were compressed against, --patch-from style.
+	std::string patch_from;
+	std::uint64_t patch_from_size = 0;
+	/// XXH64 of the reference file.
+	std::uint64_t patch_from_hash = 0;
+
+	/// Return value: the metadata frame, padded to at least pad_to bytes with whitespace.
+	std::string to_frame(std::size_t pad_to = 0) const;
+
+	/// Return value: the metadata and the size of the frame it was read from, if the buffer starts with a whole metadata frame.
+	static std::optional<std::pair<archive_metadata, std::size_t>> from_frame(const void * buf, std::size_t len);
+
+	/// Return value: as from_frame(), for the start of the specified file.
+	static std::optional<std::pair<archive_metadata, std::size_t>> from_file(const char * fname);
+};
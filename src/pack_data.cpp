@@ -21,24 +21,328 @@
 
 
 #include "pack_data.hpp"
-#include "config.hpp"
+#include "entropy.hpp"
+#include "metadata.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <bit>
+#include <climits>
+#include <cstring>
+#include <string_view>
+#define XXH_STATIC_LINKING_ONLY
+#include <zstd/common/xxhash.h>
 
 
-archive_data::archive_data() : ctx(ZSTD_createCStream(), ZSTD_freeCStream) {
-	configuration cfg;
-	ZSTD_initCStream(ctx.get(), cfg.compression_level);
+/// Input shorter than this isn't sampled, and keeps the current mode.
+static const constexpr std::size_t min_sample_size = 4 * 1024;
+
+/// Entropy needs to drop this far below the threshold to go back to compressing, so mixed regions don't thrash between frames.
+static const constexpr double threshold_hysteresis = 0.2;
+
+
+/// Return value: roughly how much a context with the specified settings will allocate.
+static std::size_t estimate_memory(int level, int strategy, int window_log, bool long_distance, int workers, std::uint64_t size_hint) {
+	const auto effective_window_log = window_log ? window_log : static_cast<int>(ZSTD_getCParams(level, size_hint, 0).windowLog);
+
+	std::unique_ptr<ZSTD_CCtx_params, decltype(&ZSTD_freeCCtxParams)> params{ZSTD_createCCtxParams(), ZSTD_freeCCtxParams};
+	ZSTD_CCtxParams_init(params.get(), level);
+	ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_strategy, strategy);
+	ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_windowLog, window_log);
+	ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_srcSizeHint, static_cast<int>(std::min<std::uint64_t>(size_hint, INT_MAX)));
+	if(long_distance) {
+		// The estimate doesn't fill in the defaults like compressing does, and divides by the minimum match length; these are zstd's for the window
+		ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_enableLongDistanceMatching, ZSTD_ps_enable);
+		ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_ldmHashLog, std::clamp(effective_window_log - 7, ZSTD_LDM_HASHLOG_MIN, ZSTD_LDM_HASHLOG_MAX));
+		ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_ldmMinMatch, 64);
+		ZSTD_CCtxParams_setParameter(params.get(), ZSTD_c_ldmBucketSizeLog, 4);
+	}
+	const auto single = ZSTD_estimateCStreamSize_usingCCtxParams(params.get());  // Only supports single-threaded compression
+	if(!workers)
+		return single;
+
+	// Every worker has a context of its own, and works on a job of 4 windows (at least 1 MiB), with as much again for its output
+	const auto job_size = std::size_t{1} << std::max(20, effective_window_log + 2);
+	return workers * (single + 2 * job_size);
+}
+
+
+archive_data::archive_data(const char * fname, const configuration & cfg, std::uint64_t size_hint)
+      : stats({}), ctx(ZSTD_createCStream(), ZSTD_freeCStream), size_hint(size_hint), storing(false), frame_started(false), switching(false),
+        frame_taken(0), splitting(false), streaming(false), flushing(false), unflushed(0), header_written(0) {
+	params                   = cfg.parameters_for(fname);
+	incompressible_threshold = cfg.incompressible_threshold;
+	frame_size               = std::uint64_t{cfg.frame_size} * 1024 * 1024;
+	flush_size               = std::uint64_t{cfg.flush_interval_size} * 1024;
+	flush_time               = std::chrono::milliseconds{cfg.flush_interval_time};
+	sha256                   = cfg.sha256;
+	hash.emplace(sha256);
+	if(!params.dictionary.empty())
+		if(auto dict = read_file(params.dictionary.c_str()))
+			dictionary = std::move(*dict);
+
+	if(fname)
+		meta.name = std::string_view{fname}.substr(std::string_view{fname}.find_last_of("\\/") + 1);
+	load_reference();
+	ZSTD_CCtx_refThreadPool(ctx.get(), share.pool());
+	if(size_hint)
+		ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_srcSizeHint, static_cast<int>(std::min<std::uint64_t>(size_hint, INT_MAX)));
+
+	apply_mode();
+}
+
+void archive_data::load_reference() {
+	reference.clear();
+	meta.patch_from.clear();
+	meta.patch_from_size = meta.patch_from_hash = 0;
+	if(params.patch_from.empty())
+		return;
+
+	if(auto ref = read_file(params.patch_from.c_str())) {
+		reference = std::move(*ref);
+
+		// Same as zstd --patch-from: the window needs to reach back across the whole reference
+		const auto window_log = std::clamp<int>(std::bit_width(std::max<std::uint64_t>(reference.size(), size_hint)), ZSTD_WINDOWLOG_MIN, ZSTD_WINDOWLOG_MAX);
+		params.window_log     = std::max(params.window_log.value_or(0), window_log);
+
+		meta.patch_from      = params.patch_from;
+		meta.patch_from_size = reference.size();
+		meta.patch_from_hash = XXH64(reference.data(), reference.size(), 0);
+	}
+}
+
+bool archive_data::append_to(const archive_metadata * existing, std::size_t frame_size) {
+	appending         = existing ? frame_size : 0;
+	meta              = existing ? *existing : archive_metadata{};
+	params.patch_from = meta.patch_from;
+	meta.content_xxh64.reset();
+	meta.content_sha256.clear();
+	load_reference();
+	apply_mode();
+
+	auto largest         = meta;
+	largest.content_size = largest.frame_count = UINT64_MAX;
+	if(largest.tar_trailer)
+		largest.tar_trailer = UINT64_MAX;
+	return existing && largest.to_frame().size() <= frame_size;
+}
+
+void archive_data::stream() {
+	streaming = flush_size || flush_time.count();
+	flushed();
+}
+
+void archive_data::tune(int level, int strategy) {
+	params.level = level;
+	if(strategy && !params.strategy)
+		params.strategy = strategy;
+	apply_mode();
+}
+
+void archive_data::flushed() {
+	unflushed  = 0;
+	last_flush = std::chrono::steady_clock::now();
+}
+
+unsigned int archive_data::dictionary_id() const {
+	return reference.empty() ? ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size()) : 0;
+}
+
+const worker_share & archive_data::threads() const {
+	return share;
+}
+
+void archive_data::apply_mode() {
+	// The share is rechecked every frame, as other operations start and finish. A single worker would only hand the work off to another thread.
+	// rsyncable needs the multithreaded compressor; it's only applied at job boundaries
+	const auto share_workers = static_cast<int>(share.workers());
+	auto workers             = std::min(params.workers.value_or(share_workers > 1 ? share_workers : 0), share_workers);
+	workers                  = std::max(workers, static_cast<int>(*params.rsyncable));
+	auto level               = storing ? ZSTD_minCLevel() : *params.level;
+	auto window_log          = storing ? 0 : params.window_log.value_or(0);
+	fit_memory(level, window_log, workers);
+
+	// Explicit parameters override the level's, so everything is set every time to not drag a strategy into stored frames
+	ZSTD_CCtx_reset(ctx.get(), ZSTD_reset_session_only);
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_compressionLevel, level);
+	// Anything matched at the lowest level would be rejected in favour of a raw block anyway
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_literalCompressionMode, storing ? ZSTD_ps_disable : ZSTD_ps_auto);
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_strategy, storing ? 0 : params.strategy.value_or(0));
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_windowLog, window_log);
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_enableLongDistanceMatching, !storing && !reference.empty() ? ZSTD_ps_enable : ZSTD_ps_auto);
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_nbWorkers, workers);
+	ZSTD_CCtx_setParameter(ctx.get(), ZSTD_c_rsyncable, *params.rsyncable);
+	// Prefixes only last for one frame, the same goes for the decoder, and replace the dictionary.
+	// Stored frames reference them too: decoding a dictionary-less frame with one would start off with the wrong repeat offsets
+	if(!reference.empty())
+		ZSTD_CCtx_refPrefix(ctx.get(), reference.data(), reference.size());
+	else if(!dictionary.empty())
+		ZSTD_CCtx_loadDictionary_byReference(ctx.get(), dictionary.data(), dictionary.size());
+}
+
+void archive_data::fit_memory(int & level, int & window_log, int & workers) {
+	const auto available = memory.available();
+	const auto estimate  = [&] {
+		return dictionary.size() + reference.size() +
+		       estimate_memory(level, storing ? 0 : params.strategy.value_or(0), window_log, !storing && !reference.empty(), workers, size_hint);
+	};
+
+	// Cheapest to give up first: workers only cost speed, the level and window ratio, and a window too small for the reference most of it
+	for(const auto min_workers = static_cast<int>(*params.rsyncable); workers > min_workers && estimate() > available;)
+		--workers;
+	while(level > 1 && estimate() > available)
+		--level;
+	if(estimate() > available) {
+		if(!window_log)
+			window_log = ZSTD_getCParams(level, size_hint, 0).windowLog;
+		while(window_log > ZSTD_WINDOWLOG_MIN && estimate() > available)
+			--window_log;
+	}
+
+	memory.reserve(estimate());
+}
+
+const std::string & archive_data::header_frame() {
+	if(header.empty() && !appending) {
+		// Leave room for the largest possible sizes and the hashes, for final_header(), and some more for what later versions record
+		auto largest         = meta;
+		largest.content_size = largest.frame_count = UINT64_MAX;
+		if(largest.tar_trailer)
+			largest.tar_trailer = UINT64_MAX;
+		largest.content_xxh64 = UINT64_MAX;
+		if(sha256)
+			largest.content_sha256.assign(64, 'f');
+		header = meta.to_frame(largest.to_frame().size() + 32);
+	}
+	return header;
+}
+
+std::size_t archive_data::write_header(void * out, std::size_t out_len) {
+	header_frame();
+	const auto len = std::min(header.size() - header_written, out_len);
+	std::memcpy(out, header.data() + header_written, len);
+	header_written += len;
+	return len;
 }
 
 std::pair<bool, std::pair<std::size_t, std::size_t>> archive_data::add_data(const void * in, std::size_t in_len, void * out, std::size_t out_len) {
 	ZSTD_inBuffer in_buf{in, in_len, 0};
-	ZSTD_outBuffer out_buf{out, out_len, 0};
+	ZSTD_outBuffer out_buf{out, out_len, write_header(out, out_len)};
+
+	// A flush has to be seen through before anything else is taken
+	if(flushing) {
+		ZSTD_inBuffer nothing{nullptr, 0, 0};
+		const auto res = ZSTD_compressStream2(ctx.get(), &out_buf, &nothing, ZSTD_e_flush);
+		if(ZSTD_isError(res))
+			return {true, {0, out_buf.pos}};
+		if(res != 0)
+			return {false, {0, out_buf.pos}};
+
+		flushing = false;
+		flushed();
+	}
 
-	const auto res = ZSTD_compressStream(ctx.get(), &out_buf, &in_buf);
+	if(!switching && in_len >= min_sample_size) {
+		const auto entropy = estimate_entropy(in, in_len);
+		if(storing ? entropy < incompressible_threshold - threshold_hysteresis : entropy >= incompressible_threshold) {
+			if(frame_started)
+				switching = true;
+			else {
+				storing = !storing;
+				apply_mode();
+			}
+		}
+	}
+
+	if(switching || splitting) {
+		ZSTD_inBuffer nothing{nullptr, 0, 0};
+		const auto res = ZSTD_compressStream2(ctx.get(), &out_buf, &nothing, ZSTD_e_end);
+		if(ZSTD_isError(res))
+			return {true, {0, out_buf.pos}};
+		if(res != 0)
+			return {false, {0, out_buf.pos}};
+
+		++stats.frames;
+		if(switching)
+			storing = !storing;
+		switching = splitting = frame_started = false;
+		frame_taken                           = 0;
+		apply_mode();
+		flushed();
+	}
+
+	// Flushing ends the workers' current jobs early, to hand over everything taken so far, and waits for them
+	const auto flush = streaming && ((flush_size && unflushed + in_len >= flush_size) ||
+	                                 (flush_time.count() && std::chrono::steady_clock::now() - last_flush >= flush_time));
+	const auto res   = ZSTD_compressStream2(ctx.get(), &out_buf, &in_buf, flush ? ZSTD_e_flush : ZSTD_e_continue);
+	frame_started    = true;
+	(storing ? stats.stored_bytes : stats.compressed_bytes) += in_buf.pos;
+	hash->update(in, in_buf.pos);
+	unflushed += in_buf.pos;
+	frame_taken += in_buf.pos;
+	splitting = frame_size && frame_taken >= frame_size;
+	if(flush && !ZSTD_isError(res)) {
+		if(res == 0)
+			flushed();
+		else
+			flushing = true;
+	}
 	return {static_cast<bool>(ZSTD_isError(res)), {in_buf.pos, out_buf.pos}};
 }
 
+std::size_t archive_data::whole_bound(std::size_t in_len) {
+	return header_frame().size() + ZSTD_compressBound(in_len);
+}
+
+std::pair<bool, std::size_t> archive_data::compress_whole(const void * in, std::size_t in_len, void * out, std::size_t out_len) {
+	if(in_len >= min_sample_size && estimate_entropy(in, in_len) >= incompressible_threshold) {
+		storing = true;
+		apply_mode();
+	}
+
+	const auto header_len = write_header(out, out_len);
+	const auto res        = ZSTD_compress2(ctx.get(), static_cast<char *>(out) + header_len, out_len - header_len, in, in_len);
+	if(ZSTD_isError(res))
+		return {true, header_len};
+
+	(storing ? stats.stored_bytes : stats.compressed_bytes) += in_len;
+	++stats.frames;
+	hash->update(in, in_len);
+	return {false, header_len + res};
+}
+
 std::tuple<bool, bool, std::size_t> archive_data::finish(void * out, std::size_t out_len) {
-	ZSTD_outBuffer out_buf{out, out_len, 0};
+	ZSTD_outBuffer out_buf{out, out_len, write_header(out, out_len)};
 	const auto res = ZSTD_endStream(ctx.get(), &out_buf);
+	if(res == 0) {
+		++stats.frames;
+		frame_started = flushing = splitting = false;
+		frame_taken                          = 0;
+		apply_mode();  // For the reference, which only lasts a frame
+		flushed();
+	}
 	return {static_cast<bool>(ZSTD_isError(res)), res == 0, out_buf.pos};
 }
+
+std::string archive_data::final_header() {
+	const auto frame_size = appending.value_or(header.size());
+	if(!frame_size)
+		return {};
+
+	auto final = meta;
+	if(!appending || meta.content_size)
+		final.content_size = meta.content_size.value_or(0) + stats.compressed_bytes + stats.stored_bytes;
+	if(!appending || meta.frame_count)
+		final.frame_count = meta.frame_count.value_or(0) + stats.frames;
+	if(!appending)
+		hash->finish(final);
+	if(final.to_frame().size() > frame_size) {
+		final.content_size = final.frame_count = std::nullopt;
+		final.content_xxh64.reset();
+		final.content_sha256.clear();
+	}
+
+	auto ret = final.to_frame(frame_size);
+	if(ret.size() != frame_size)
+		return {};
+	return ret;
+}
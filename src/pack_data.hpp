@@ -23,29 +23,122 @@
 #pragma once
 
 
+#include "checksum.hpp"
+#include "config.hpp"
+#include "memory_budget.hpp"
+#include "metadata.hpp"
+#include "worker_pool.hpp"
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <optional>
+#include <string>
 #include <tuple>
 #include <utility>
 #include <zstd/zstd.h>
 
 
 class archive_data {
+public:
+	struct statistics {
+		std::uint64_t compressed_bytes;
+		/// Input taken while in a region judged incompressible.
+		std::uint64_t stored_bytes;
+		std::uint64_t frames;
+	} stats;
+
+	/// Written out ahead of everything else. Fill in before packing anything, bar the sizes, which final_header() takes care of.
+	archive_metadata meta;
+
 private:
 	std::unique_ptr<ZSTD_CStream, decltype(&ZSTD_freeCStream)> ctx;
+	compression_parameters params;
+	worker_share share;
+	memory_reservation memory;
+	std::uint64_t size_hint;
+	std::string dictionary, reference;
+	double incompressible_threshold;
+	bool storing, frame_started, switching;
+	/// Frames are ended, once they've taken frame_size, with splitting, as for switching, but keeping the mode.
+	std::uint64_t frame_size, frame_taken;
+	bool splitting;
+	/// Set by stream(): flush once this much has been taken, or this long has passed, since the last flush, if set.
+	std::uint64_t flush_size;
+	std::chrono::milliseconds flush_time;
+	bool streaming, flushing;
+	std::uint64_t unflushed;
+	std::chrono::steady_clock::time_point last_flush;
+	/// Of everything taken, for the metadata frame; with SHA-256 if "sha256" is set.
+	std::optional<content_hash> hash;
+	bool sha256;
+	/// Metadata frame, written out ahead of everything else. Made on first use, padded to fit the final sizes.
+	std::string header;
+	std::size_t header_written;
+	/// Set by append_to(): the size of the existing metadata frame, if any, to be rewritten instead.
+	std::optional<std::size_t> appending;
+
+	void flushed();
+	void load_reference();
+	void apply_mode();
+	void fit_memory(int & level, int & window_log, int & workers);
+	const std::string & header_frame();
+	std::size_t write_header(void * out, std::size_t out_len);
 
 
 public:
-	archive_data();
+	/// Compress with the settings configured for the specified file name, or the global ones if nullptr.
+	///
+	/// size_hint is the expected input size, if known, used to size the window when compressing against a reference file.
+	archive_data(const char * fname, const configuration & cfg, std::uint64_t size_hint = 0);
+
+	/// Continue an existing archive instead: no metadata frame is written, and the reference file it was made against, if any, is used again.
+	///
+	/// existing is its metadata, if any, and frame_size the size of the frame it was read from. Call before packing anything.
+	///
+	/// Return value: whether final_header() will fit in the existing frame with all the sizes.
+	bool append_to(const archive_metadata * existing, std::size_t frame_size);
+
+	/// Flush the output every "flush‐interval‐size" KiB or "flush‐interval‐time" ms, so it's a steady stream, at some cost in ratio.
+	///
+	/// While a flush doesn't fit in the output buffer nothing will be taken.
+	void stream();
+
+	/// Use the specified level, and strategy unless 0 or configured, as picked by autotune(). Call before packing anything.
+	void tune(int level, int strategy);
+
+	/// Return value: the ID of the dictionary frames are compressed with, 0 if none.
+	unsigned int dictionary_id() const;
+
+	/// Return value: this archive's claim on the worker threads, for work done on its behalf.
+	const worker_share & threads() const;
 
 	/// Pack data from the specified buffer into the specified buffer.
 	///
+	/// The input is sampled first: when it flips between compressible and incompressible the current frame is ended and the next one started
+	/// with the matching settings, during which nothing will be taken. Likewise once the frame's taken "frame‐size".
+	///
 	/// Return value: {errorred, {bytes taken, bytes written}}.
 	std::pair<bool, std::pair<std::size_t, std::size_t>> add_data(const void * in, std::size_t in_len, void * out, std::size_t out_len);
 
+	/// Worst-case output size of compress_whole().
+	std::size_t whole_bound(std::size_t in_len);
+
+	/// Pack the whole input in one go, as a single frame with the content size recorded, instead of add_data() and finish().
+	///
+	/// Return value: {errorred, bytes written}.
+	std::pair<bool, std::size_t> compress_whole(const void * in, std::size_t in_len, void * out, std::size_t out_len);
+
 	/// Flush data and finish the archive.
 	///
 	/// You might need to call this multiple times if the output buffer is too small.
+	/// Anything added afterwards goes into a new frame.
 	///
 	/// Return value: {errorred, finished, bytes written}.
 	std::tuple<bool, bool, std::size_t> finish(void * out, std::size_t out_len);
+
+	/// Return value: the metadata frame with the sizes and hashes filled in, to write over the one at the start of the finished archive,
+	/// without them if they don't fit, or empty if there's nothing to rewrite.
+	///
+	/// Call once, after finishing. The hashes are left out when appending, since they'd need the existing content.
+	std::string final_header();
 };
@@ -0,0 +1,120 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "read_queue.hpp"
+#include <algorithm>
+#include <utility>
+
+
+read_queue::read_queue(HANDLE f, std::uint64_t fsize, std::uint64_t offset, std::size_t depth, std::size_t minsize, std::size_t maxsize)
+      : file(f), file_size(fsize), next_offset(offset), read_size(std::max<std::size_t>(minsize, 1)), min_size(read_size), max_size(std::max(maxsize, read_size)),
+        ready_streak(0), slots(std::max<std::size_t>(depth, 1)), head(0), errored(false) {
+	for(auto && s : slots) {
+		s.capacity          = 0;
+		s.requested         = 0;
+		s.overlapped        = {};
+		s.overlapped.hEvent = CreateEvent(nullptr, true, false, nullptr);  // Each its own, since there's many in flight on one handle
+	}
+	for(auto && s : slots)
+		issue(s);
+}
+
+read_queue::~read_queue() {
+	for(auto && s : slots) {
+		if(s.requested) {
+			DWORD read;
+			CancelIoEx(file, &s.overlapped);
+			GetOverlappedResult(file, &s.overlapped, &read, true);
+		}
+		CloseHandle(s.overlapped.hEvent);
+	}
+}
+
+void read_queue::issue(slot & into) {
+	into.requested = 0;
+	if(errored || next_offset >= file_size)
+		return;
+
+	const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(read_size, file_size - next_offset));
+	if(into.capacity < len || into.capacity > read_size) {  // Larger ones are given back once reads shrink
+		into.data.reset();                                   // Don't hold on to both
+		into.data     = std::make_unique<char[]>(read_size);
+		into.capacity = read_size;
+	}
+
+	const auto event           = into.overlapped.hEvent;
+	into.overlapped            = {};
+	into.overlapped.hEvent     = event;
+	into.overlapped.OffsetHigh = next_offset >> 32;
+	into.overlapped.Offset     = next_offset & 0xFFFFFFFF;
+	if(!ReadFile(file, into.data.get(), len, nullptr, &into.overlapped) && GetLastError() != ERROR_IO_PENDING) {
+		errored = true;
+		return;
+	}
+
+	into.requested = len;
+	next_offset += len;
+}
+
+void read_queue::limit(std::size_t maxsize) {
+	max_size  = std::max<std::size_t>(std::min(maxsize, max_size), 1);
+	min_size  = std::min(min_size, max_size);
+	read_size = std::min(read_size, max_size);
+}
+
+std::optional<std::pair<const char *, std::size_t>> read_queue::next() {
+	// Ring order: the one handed out last goes to the back of the queue
+	if(lent) {
+		issue(slots[*lent]);
+		lent.reset();
+	}
+
+	auto & cur = slots[head];
+	if(!cur.requested) {
+		if(errored)
+			return std::nullopt;
+		return std::make_pair(static_cast<const char *>(nullptr), std::size_t{});
+	}
+
+	DWORD read;
+	auto done = GetOverlappedResult(file, &cur.overlapped, &read, false);
+	if(!done && GetLastError() == ERROR_IO_INCOMPLETE) {
+		// Decoding outpaces reading: make the following reads bigger
+		read_size    = std::min(read_size * 2, max_size);
+		ready_streak = 0;
+		done         = GetOverlappedResult(file, &cur.overlapped, &read, true);
+	} else if(++ready_streak == slots.size()) {
+		// Reading's kept the whole queue ahead of decoding: smaller reads do as well, in less memory
+		read_size    = std::max(read_size / 2, min_size);
+		ready_streak = 0;
+	}
+
+	const auto requested = std::exchange(cur.requested, 0);
+	if(!done || read != requested) {  // A short read would leave a hole before the ones queued after it
+		errored = true;
+		return std::nullopt;
+	}
+
+	lent = head;
+	head = (head + 1) % slots.size();
+	return std::make_pair(static_cast<const char *>(cur.data.get()), static_cast<std::size_t>(read));
+}
@@ -0,0 +1,79 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+/// Keeps up to depth overlapped reads of a file in flight, into buffers from a pool.
+///
+/// Reads start at min_size, capped at what's left of the file, and double (up to max_size) each time the consumer has to wait for one,
+/// so slow and high-latency storage gets fewer, larger reads. Once depth reads in a row were done before the consumer got to them,
+/// they halve again (down to min_size), so a decoder slower than the storage isn't holding more memory than it needs to stay fed.
+class read_queue {
+private:
+	struct slot {
+		std::unique_ptr<char[]> data;
+		std::size_t capacity;
+		std::size_t requested;
+		OVERLAPPED overlapped;
+	};
+
+	HANDLE file;
+	std::uint64_t file_size, next_offset;
+	std::size_t read_size, min_size, max_size;
+	/// Reads in a row that were done by the time they were asked for.
+	std::size_t ready_streak;
+	std::vector<slot> slots;
+	std::size_t head;
+	std::optional<std::size_t> lent;
+	bool errored;
+
+	void issue(slot & into);
+
+
+public:
+	read_queue(HANDLE file, std::uint64_t file_size, std::uint64_t offset, std::size_t depth, std::size_t min_size, std::size_t max_size);
+	~read_queue();
+	read_queue(const read_queue &) = delete;
+	read_queue(read_queue &&)      = delete;
+
+	/// Lower the size reads may grow to. Ones already issued are unaffected.
+	void limit(std::size_t max_size);
+
+	/// Wait for the next read in order. The previously returned buffer is recycled.
+	///
+	/// Return value: {data, length}, length 0 at EOF, or nullopt if a read failed.
+	std::optional<std::pair<const char *, std::size_t>> next();
+};
@@ -0,0 +1,127 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "search.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TOTALCMD_ZSTD_SEARCH_SSE2 1
+#endif
+
+
+pattern_matcher::pattern_matcher(std::vector<std::string> pats) : patterns(std::move(pats)), longest(0) {
+	for(auto && pattern : patterns)
+		longest = std::max(longest, pattern.size());
+}
+
+std::size_t pattern_matcher::length(std::size_t pattern) const {
+	return patterns[pattern].size();
+}
+
+std::size_t pattern_matcher::overlap() const {
+	return longest ? longest - 1 : 0;
+}
+
+bool pattern_matcher::scan(const char * data, std::size_t len, std::uint64_t base, const match_callback & found) const {
+	const auto matches_at = [&](const std::string & pattern, std::size_t at) {
+		return !std::memcmp(data + at + 1, pattern.data() + 1, pattern.size() - 1);  // The first byte's already been checked
+	};
+
+	std::size_t start = 0;
+#ifdef TOTALCMD_ZSTD_SEARCH_SSE2
+	// Each block of 16 candidate positions is loaded once for the first bytes, and once more for the last bytes of each length;
+	// the block's matches for all the patterns are then reported in order, like the positions after it are
+	std::vector<std::pair<std::size_t, std::size_t>> hits;
+	for(; longest && start + longest - 1 + 16 <= len; start += 16) {
+		const auto block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + start));
+		hits.clear();
+		for(std::size_t p = 0; p != patterns.size(); ++p) {
+			const auto & pattern = patterns[p];
+			if(pattern.empty())
+				continue;
+
+			const auto last = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + start + pattern.size() - 1));
+			auto candidates = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(pattern.front())),
+			                                                                            _mm_cmpeq_epi8(last, _mm_set1_epi8(pattern.back())))));
+			for(; candidates; candidates &= candidates - 1)
+				if(const auto at = start + std::countr_zero(candidates); matches_at(pattern, at))
+					hits.emplace_back(at, p);
+		}
+
+		if(hits.size() > 1)
+			std::sort(hits.begin(), hits.end());
+		for(auto && [at, p] : hits)
+			if(!found(p, base + at))
+				return false;
+	}
+#endif
+
+	for(; start < len; ++start)
+		for(std::size_t p = 0; p != patterns.size(); ++p) {
+			const auto & pattern = patterns[p];
+			if(!pattern.empty() && pattern.size() <= len - start && data[start] == pattern.front() && matches_at(pattern, start) && !found(p, base + start))
+				return false;
+		}
+	return true;
+}
+
+
+pattern_stream::pattern_stream(const pattern_matcher & m, std::uint64_t off) : matcher(m), offset(off) {}
+
+bool pattern_stream::feed(const char * data, std::size_t len, const match_callback & found) {
+	if(!seam(data, len, found) || !matcher.scan(data, len, offset, found))
+		return false;
+	skip(len, {data, len});
+	return true;
+}
+
+bool pattern_stream::seam(const char * data, std::size_t len, const match_callback & found) {
+	if(carry.empty())
+		return true;
+
+	// Matches starting in the carry were found with it if they fit in it; the rest are found with the start of the data
+	auto joined            = carry;
+	const auto carry_start = offset - carry.size();
+	joined.append(data, std::min(len, matcher.overlap()));
+	return matcher.scan(joined.data(), joined.size(), carry_start, [&](std::size_t pattern, std::uint64_t at) {
+		const auto start = at - carry_start;
+		return start >= carry.size() || start + matcher.length(pattern) <= carry.size() || found(pattern, at);
+	});
+}
+
+void pattern_stream::skip(std::uint64_t len, std::string_view tail) {
+	const auto overlap = matcher.overlap();
+	offset += len;
+	if(tail.size() >= overlap)
+		carry.assign(tail.substr(tail.size() - overlap));
+	else {
+		carry.append(tail);
+		carry.erase(0, carry.size() - std::min(carry.size(), overlap));
+	}
+}
+
+const std::string & pattern_stream::tail() const {
+	return carry;
+}
@@ -0,0 +1,85 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/// Called for each match with the index of the pattern and its offset; returning false stops the search.
+using match_callback = std::function<bool(std::size_t pattern, std::uint64_t offset)>;
+
+
+/// Finds any of a set of byte strings, checking the first and last byte of each at 16 positions at a time with SSE2, where available,
+/// and comparing the rest only where both match.
+class pattern_matcher {
+private:
+	std::vector<std::string> patterns;
+	std::size_t longest;
+
+
+public:
+	/// Empty patterns never match.
+	pattern_matcher(std::vector<std::string> patterns);
+
+	std::size_t length(std::size_t pattern) const;
+
+	/// Return value: how many bytes at the end of one piece of data a match can start in and still need the next piece, one less than the longest pattern.
+	std::size_t overlap() const;
+
+	/// Find every match wholly within the data, offset from base, in order of offset, then of pattern.
+	///
+	/// Return value: false if found stopped the search.
+	bool scan(const char * data, std::size_t len, std::uint64_t base, const match_callback & found) const;
+};
+
+/// Passes data fed to it in order through a pattern_matcher, so matches split between the pieces are found too.
+class pattern_stream {
+private:
+	const pattern_matcher & matcher;
+	/// The last overlap() bytes fed.
+	std::string carry;
+	std::uint64_t offset;
+
+
+public:
+	pattern_stream(const pattern_matcher & matcher, std::uint64_t offset = 0);
+
+	/// Return value: false if found stopped the search.
+	bool feed(const char * data, std::size_t len, const match_callback & found);
+
+	/// Find just the matches starting in what's been fed so far and continuing into the specified data, which comes right after it.
+	///
+	/// Return value: false if found stopped the search.
+	bool seam(const char * data, std::size_t len, const match_callback & found);
+
+	/// Move past len bytes, searched some other way, ending with the specified tail, at least their last overlap() bytes or all of them.
+	void skip(std::uint64_t len, std::string_view tail);
+
+	/// Return value: the last overlap() bytes fed, or all of them if fewer.
+	const std::string & tail() const;
+};
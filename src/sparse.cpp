@@ -0,0 +1,205 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "sparse.hpp"
+#include <algorithm>
+#include <cstring>
+#include <winioctl.h>
+
+
+static const constexpr std::size_t read_size = 1024 * 1024;
+/// NTFS allocates sparse files in 64 KiB units: anything smaller wouldn't be left out anyway.
+static const constexpr std::size_t hole_size = 64 * 1024;
+
+/// Handed out for holes, never written to.
+static char zeros[read_size];
+
+
+sparse_filebuf::sparse_filebuf(const char * path)
+      : file(CreateFileA(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)), range(0),
+        offset(0), file_offset(0), size(0) {
+	if(file == INVALID_HANDLE_VALUE)
+		return;
+	GetFileSizeEx(file, reinterpret_cast<LARGE_INTEGER *>(&size));
+	buffer = std::make_unique<char[]>(read_size);
+
+	if(const auto attributes = GetFileAttributesA(path); attributes != INVALID_FILE_ATTRIBUTES && attributes & FILE_ATTRIBUTE_SPARSE_FILE) {
+		FILE_ALLOCATED_RANGE_BUFFER query{}, found[64];
+		query.Length.QuadPart = size;
+		for(;;) {
+			DWORD returned{};
+			const auto done = DeviceIoControl(file, FSCTL_QUERY_ALLOCATED_RANGES, &query, sizeof(query), found, sizeof(found), &returned, nullptr);
+			if(!done && GetLastError() != ERROR_MORE_DATA) {
+				ranges.clear();
+				break;
+			}
+
+			for(std::size_t i = 0; i != returned / sizeof(*found); ++i)
+				ranges.emplace_back(found[i].FileOffset.QuadPart, found[i].FileOffset.QuadPart + found[i].Length.QuadPart);
+			if(done)
+				break;
+			if(!returned) {
+				ranges.clear();
+				break;
+			}
+			// Carry on after the last range returned
+			query.FileOffset.QuadPart = ranges.back().second;
+			query.Length.QuadPart     = size - ranges.back().second;
+		}
+		if(!ranges.empty() || size == 0)
+			return;
+	}
+	ranges.emplace_back(0, size);
+}
+
+sparse_filebuf::~sparse_filebuf() {
+	if(file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+}
+
+bool sparse_filebuf::is_open() const {
+	return file != INVALID_HANDLE_VALUE;
+}
+
+sparse_filebuf::int_type sparse_filebuf::underflow() {
+	if(file == INVALID_HANDLE_VALUE || offset >= size)
+		return traits_type::eof();
+
+	while(range != ranges.size() && ranges[range].second <= offset)
+		++range;
+	if(range == ranges.size() || offset < ranges[range].first) {
+		// In a hole, up to the next allocated range
+		const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(read_size, (range == ranges.size() ? size : ranges[range].first) - offset));
+		setg(zeros, zeros, zeros + len);
+		offset += len;
+		return traits_type::to_int_type(*gptr());
+	}
+
+	if(file_offset != offset) {
+		LARGE_INTEGER to;
+		to.QuadPart = offset;
+		if(!SetFilePointerEx(file, to, nullptr, FILE_BEGIN))
+			return traits_type::eof();
+		file_offset = offset;
+	}
+	DWORD read{};
+	if(!ReadFile(file, buffer.get(), static_cast<DWORD>(std::min<std::uint64_t>(read_size, ranges[range].second - offset)), &read, nullptr) || !read)
+		return traits_type::eof();
+	setg(buffer.get(), buffer.get(), buffer.get() + read);
+	offset += read;
+	file_offset += read;
+	return traits_type::to_int_type(*gptr());
+}
+
+
+sparse_ifstream::sparse_ifstream(const std::string & path) : std::istream(nullptr), buf(path.c_str()) {
+	rdbuf(&buf);
+	if(!buf.is_open())
+		setstate(std::ios::failbit);
+}
+
+
+sparse_writer::sparse_writer(std::ostream & to) : to(to), position(to.tellp()), written_end(position), end(position) {}
+
+std::streamsize sparse_writer::xsputn(const char * data, std::streamsize len) {
+	// Only whole aligned blocks are left out, where they'd have been allocated; runs of the rest are written in one go
+	const auto hole_at = [&](std::streamsize at, std::uint64_t pos) {
+		return len - at >= static_cast<std::streamsize>(hole_size) && pos % hole_size == 0 && !data[at] && !std::memcmp(data + at, data + at + 1, hole_size - 1);
+	};
+
+	for(std::streamsize done = 0; done != len;) {
+		const auto hole = hole_at(done, position);
+		auto run        = std::min<std::streamsize>(len - done, hole_size - position % hole_size);
+		while(done + run != len && hole_at(done + run, position + run) == hole)
+			run += std::min<std::streamsize>(len - done - run, hole_size);
+
+		if(hole)
+			to.seekp(run, std::ios::cur);
+		else
+			to.write(data + done, run);
+		if(!to)
+			return done;
+
+		position += run;
+		done += run;
+		if(!hole)
+			written_end = std::max(written_end, position);
+		end = std::max(end, position);
+	}
+	return len;
+}
+
+sparse_writer::int_type sparse_writer::overflow(int_type ch) {
+	if(traits_type::eq_int_type(ch, traits_type::eof()))
+		return traits_type::not_eof(ch);
+	const auto c = traits_type::to_char_type(ch);
+	return xsputn(&c, 1) == 1 ? ch : traits_type::eof();
+}
+
+sparse_writer::pos_type sparse_writer::seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) {
+	if(dir == std::ios::cur)
+		return seekpos(position + off, which);
+	if(dir == std::ios::beg)
+		return seekpos(off, which);
+	return pos_type(off_type(-1));
+}
+
+sparse_writer::pos_type sparse_writer::seekpos(pos_type pos, std::ios::openmode which) {
+	if(!(which & std::ios::out) || !to.seekp(pos))
+		return pos_type(off_type(-1));
+	position = pos;
+	return pos;
+}
+
+bool sparse_writer::finish() {
+	if(end > written_end) {
+		to.seekp(end - 1);
+		to.put('\0');
+		to.seekp(position);
+		written_end = end;
+	}
+	return static_cast<bool>(to.flush());
+}
+
+int sparse_writer::sync() {
+	return finish() ? 0 : -1;
+}
+
+
+sparse_ostream::sparse_ostream(std::ostream & to) : std::ostream(nullptr), buf(to) {
+	rdbuf(&buf);
+}
+
+bool sparse_ostream::finish() {
+	return buf.finish();
+}
+
+
+bool mark_sparse(const char * path) {
+	const auto file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+	DWORD returned;
+	const auto ok = DeviceIoControl(file, FSCTL_SET_SPARSE, nullptr, 0, nullptr, 0, &returned, nullptr);
+	CloseHandle(file);
+	return ok;
+}
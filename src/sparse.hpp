@@ -0,0 +1,113 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/// Reads a file like std::filebuf, but only its allocated ranges off the disk: the holes in sparse files are made up as zeros, without reading them.
+class sparse_filebuf : public std::streambuf {
+private:
+	HANDLE file;
+	/// {start, end} of the allocated ranges, in order; the whole file if it's not sparse, or they couldn't be queried.
+	std::vector<std::pair<std::uint64_t, std::uint64_t>> ranges;
+	std::size_t range;
+	std::uint64_t offset, file_offset, size;
+	std::unique_ptr<char[]> buffer;
+
+protected:
+	int_type underflow() override;
+
+public:
+	sparse_filebuf(const char * path);
+	~sparse_filebuf();
+
+	bool is_open() const;
+};
+
+/// std::ifstream over a sparse_filebuf.
+class sparse_ifstream : public std::istream {
+private:
+	sparse_filebuf buf;
+
+public:
+	explicit sparse_ifstream(const std::string & path);
+};
+
+
+/// Writes through to another stream, seeking over whole aligned blocks of zeros instead of writing them, which leaves holes in files marked sparse.
+class sparse_writer : public std::streambuf {
+private:
+	std::ostream & to;
+	std::uint64_t position;
+	/// The furthest written to, and skipped to.
+	std::uint64_t written_end, end;
+
+protected:
+	std::streamsize xsputn(const char * data, std::streamsize len) override;
+	int_type overflow(int_type ch) override;
+	pos_type seekoff(off_type off, std::ios::seekdir dir, std::ios::openmode which) override;
+	pos_type seekpos(pos_type pos, std::ios::openmode which) override;
+	/// Flushing finish()es, so the file's as long as what's been written so far.
+	int sync() override;
+
+public:
+	sparse_writer(std::ostream & to);
+
+	/// Write the last byte if it was skipped, so the file ends where it should.
+	///
+	/// Return value: whether everything's been written.
+	bool finish();
+};
+
+/// std::ostream over a sparse_writer.
+class sparse_ostream : public std::ostream {
+private:
+	sparse_writer buf;
+
+public:
+	explicit sparse_ostream(std::ostream & to);
+
+	/// sparse_writer::finish().
+	bool finish();
+};
+
+
+/// Mark the specified file sparse, so skipping over parts of it when writing leaves them unallocated.
+///
+/// Return value: whether the file system supports it and it's now sparse.
+bool mark_sparse(const char * path);
@@ -0,0 +1,165 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "tar.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+
+/// Write value into field as zero-padded octal, NUL-terminated; base-256 if it doesn't fit.
+static void put_number(char * field, std::size_t len, std::uint64_t value) {
+	if(value < (std::uint64_t{1} << (3 * (len - 1)))) {
+		std::snprintf(field, len, "%0*llo", static_cast<int>(len - 1), static_cast<unsigned long long>(value));
+		return;
+	}
+
+	std::memset(field, 0, len);
+	field[0] = static_cast<char>(0x80);
+	for(auto i = len - 1; i && value; --i, value >>= 8)
+		field[i] = static_cast<char>(value & 0xFF);
+}
+
+/// Read a number written by put_number(), or by other tars, which may pad it with spaces instead.
+static std::uint64_t get_number(const char * field, std::size_t len) {
+	std::uint64_t ret = 0;
+	if(field[0] & 0x80) {
+		for(std::size_t i = 1; i != len; ++i)
+			ret = ret << 8 | static_cast<unsigned char>(field[i]);
+		return ret;
+	}
+
+	std::size_t i = 0;
+	while(i != len && field[i] == ' ')
+		++i;
+	for(; i != len && field[i] >= '0' && field[i] <= '7'; ++i)
+		ret = ret << 3 | (field[i] - '0');
+	return ret;
+}
+
+/// Return value: sum of the header's bytes with its checksum field taken as spaces.
+static unsigned int header_checksum(const char * block) {
+	unsigned int ret = 0;
+	for(std::size_t i = 0; i != tar_block_size; ++i)
+		ret += i >= 148 && i < 156 ? ' ' : static_cast<unsigned char>(block[i]);
+	return ret;
+}
+
+static std::string header_block(const std::string & name, const std::string & prefix, std::uint64_t size, std::int64_t mtime, char type,
+                                const std::string & link = {}) {
+	std::string block(tar_block_size, '\0');
+	std::memcpy(&block[0], name.data(), std::min<std::size_t>(name.size(), 100));
+	put_number(&block[100], 8, type == '5' ? 0755 : 0644);  // mode
+	put_number(&block[108], 8, 0);                           // uid
+	put_number(&block[116], 8, 0);                           // gid
+	put_number(&block[124], 12, size);
+	put_number(&block[136], 12, static_cast<std::uint64_t>(std::max<std::int64_t>(mtime, 0)));
+	block[156] = type;
+	std::memcpy(&block[157], link.data(), std::min<std::size_t>(link.size(), 100));
+	std::memcpy(&block[257], "ustar", 6);
+	std::memcpy(&block[263], "00", 2);
+	std::memcpy(&block[345], prefix.data(), std::min<std::size_t>(prefix.size(), 155));
+
+	std::memset(&block[148], ' ', 8);
+	std::snprintf(&block[148], 8, "%06o", header_checksum(block.data()));
+	return block;
+}
+
+/// Return value: a GNU record with the specified long name or link name for the header after it.
+static std::string long_name_record(char type, const std::string & name) {
+	auto ret = header_block("././@LongLink", {}, name.size() + 1, 0, type);
+	ret += name;
+	ret.append(1 + tar_padding(name.size() + 1), '\0');
+	return ret;
+}
+
+
+std::string tar_header(const std::string & path, std::uint64_t size, std::int64_t mtime, bool directory) {
+	const auto name = directory && !path.ends_with('/') ? path + '/' : path;
+	const auto type = directory ? '5' : '0';
+
+	if(name.size() <= 100)
+		return header_block(name, {}, size, mtime, type);
+
+	// Split at the last slash that fits in the prefix (not a directory's trailing one), if that leaves the name short enough
+	const auto split = name.rfind('/', std::min<std::size_t>(155, name.size() - 2));
+	if(split != std::string::npos && split != 0 && name.size() - split - 1 <= 100)
+		return header_block(name.substr(split + 1), name.substr(0, split), size, mtime, type);
+
+	return long_name_record('L', name) + header_block(name.substr(0, 100), {}, size, mtime, type);
+}
+
+std::string tar_link_header(const std::string & name, const std::string & target, std::int64_t mtime) {
+	std::string ret;
+	if(target.size() > 100)
+		ret += long_name_record('K', target);
+	if(name.size() > 100)
+		ret += long_name_record('L', name);
+	return ret + header_block(name.substr(0, 100), {}, 0, mtime, '1', target.substr(0, 100));
+}
+
+std::size_t tar_padding(std::uint64_t size) {
+	return (tar_block_size - size % tar_block_size) % tar_block_size;
+}
+
+std::optional<tar_entry> parse_tar_header(const char * block) {
+	if(get_number(block + 148, 8) != header_checksum(block) || is_tar_trailer_block(block))
+		return std::nullopt;
+
+	const auto field = [&](std::size_t offset, std::size_t len) { return std::string(block + offset, std::find(block + offset, block + offset + len, '\0')); };
+
+	tar_entry ret{field(0, 100), get_number(block + 124, 12), static_cast<std::int64_t>(get_number(block + 136, 12)), block[156], field(157, 100)};
+	if(!std::memcmp(block + 257, "ustar", 5))
+		if(const auto prefix = field(345, 155); !prefix.empty())
+			ret.name = prefix + '/' + ret.name;
+	if(ret.type == '\0' || ret.type == '7')
+		ret.type = '0';
+	return ret;
+}
+
+bool is_tar_trailer_block(const char * block) {
+	return std::all_of(block, block + tar_block_size, [](char c) { return c == '\0'; });
+}
+
+void apply_pax_header(const std::string & records, tar_entry & to) {
+	// "length key=value\n", length counting all of it
+	for(std::size_t pos = 0; pos < records.size();) {
+		char * end;
+		const auto len = std::strtoull(records.c_str() + pos, &end, 10);
+		const auto eq  = records.find('=', end - records.c_str());
+		if(!len || pos + len > records.size() || eq == std::string::npos || eq >= pos + len)
+			break;
+
+		const auto key   = records.substr(end - records.c_str() + 1, eq - (end - records.c_str() + 1));
+		const auto value = records.substr(eq + 1, pos + len - 1 - (eq + 1));
+		if(key == "path")
+			to.name = value;
+		else if(key == "linkpath")
+			to.link = value;
+		else if(key == "size")
+			to.size = std::strtoull(value.c_str(), nullptr, 10);
+		else if(key == "mtime")
+			to.mtime = std::strtoll(value.c_str(), nullptr, 10);
+		pos += len;
+	}
+}
@@ -0,0 +1,75 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+
+static const constexpr std::size_t tar_block_size = 512;
+
+/// Two zero blocks end a tarball.
+static const constexpr std::size_t tar_trailer_size = 2 * tar_block_size;
+
+/// Long name and pax records are read whole; ones larger than this are taken to be damage, not names.
+static const constexpr std::size_t tar_max_record_size = 1024 * 1024;
+
+
+/// A header block, as read.
+struct tar_entry {
+	/// /-separated: the ustar prefix and name joined.
+	std::string name;
+	std::uint64_t size;
+	/// In seconds since the Unix epoch.
+	std::int64_t mtime;
+	/// '0' for files (old-style '\0' and contiguous '7' ones too), '1' for hard links, '5' for directories,
+	/// 'L' and 'K' for GNU long names and link names, 'x' and 'g' for pax extended headers.
+	char type;
+	/// What a link points to.
+	std::string link;
+};
+
+
+/// Return value: the ustar header for a member with the specified /-separated name, preceded by a GNU long name record
+/// if it doesn't fit in the header's name and prefix fields.
+///
+/// mtime is in seconds since the Unix epoch. Sizes past the octal field's 8 GiB are stored in base-256, as GNU tar does.
+std::string tar_header(const std::string & name, std::uint64_t size, std::int64_t mtime, bool directory);
+
+/// Return value: the header for a hard link to the specified earlier member, preceded by GNU long name records for names that don't fit.
+std::string tar_link_header(const std::string & name, const std::string & target, std::int64_t mtime);
+
+/// Return value: how many zero bytes pad a member of the specified size to a whole block.
+std::size_t tar_padding(std::uint64_t size);
+
+/// Return value: the header in the specified block, or nullopt if it's all zeros or not a header at all.
+std::optional<tar_entry> parse_tar_header(const char * block);
+
+/// Return value: whether the specified block is all zeros, as at the end of a tarball.
+bool is_tar_trailer_block(const char * block);
+
+/// Apply the path, linkpath, size and mtime records of a pax extended header to the entry following it.
+void apply_pax_header(const std::string & records, tar_entry & to);
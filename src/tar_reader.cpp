@@ -0,0 +1,153 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "tar_reader.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <wcxhead.h>
+
+
+/// The tarball's passed over in chunks of this size, this many at a time.
+static const constexpr std::size_t chunk_size  = 1024 * 1024;
+static const constexpr std::size_t chunk_depth = 4;
+
+
+tar_reader::tar_reader(std::function<int(std::ostream &)> decode) : decoded(std::move(decode), chunk_depth, chunk_size), left(0), padding(0), err(0) {}
+
+bool tar_reader::take(char * into, std::size_t len) {
+	while(len) {
+		const auto piece = decoded.next(len);
+		if(!piece || !piece->second)
+			return false;
+		std::memcpy(into, piece->first, piece->second);
+		into += piece->second;
+		len -= piece->second;
+	}
+	return true;
+}
+
+bool tar_reader::skip(std::uint64_t len) {
+	while(len) {
+		const auto piece = decoded.next(static_cast<std::size_t>(std::min<std::uint64_t>(len, SIZE_MAX)));
+		if(!piece || !piece->second)
+			return false;
+		len -= piece->second;
+	}
+	return true;
+}
+
+int tar_reader::next(member & into) {
+	const auto cut_off = [&] { return error() ? error() : E_BAD_ARCHIVE; };
+	if(!skip(left + padding))
+		return cut_off();
+	left = padding = 0;
+
+	// Long names and pax records apply to the entry after them
+	std::optional<std::string> long_name, long_link;
+	std::string pax;
+	for(char block[tar_block_size];;) {
+		if(!take(block, sizeof(block)))
+			return cut_off();
+		if(is_tar_trailer_block(block)) {
+			// Read to the end of the stream, which is only checked against the recorded hashes there
+			skip(UINT64_MAX);
+			return error() ? error() : E_END_ARCHIVE;
+		}
+
+		auto entry = parse_tar_header(block);
+		if(!entry)
+			return E_BAD_ARCHIVE;
+
+		switch(entry->type) {
+			case 'L':
+			case 'K':
+			case 'x': {
+				if(entry->size > tar_max_record_size)
+					return E_BAD_ARCHIVE;
+				std::string data(entry->size, '\0');
+				if(!take(data.data(), data.size()) || !skip(tar_padding(entry->size)))
+					return cut_off();
+				if(entry->type == 'L')
+					long_name = data.c_str();  // NUL-terminated
+				else if(entry->type == 'K')
+					long_link = data.c_str();
+				else
+					pax = std::move(data);
+			} break;
+
+			case '0':
+			case '1':
+			case '5':
+				if(long_name)
+					entry->name = std::move(*long_name);
+				if(long_link)
+					entry->link = std::move(*long_link);
+				apply_pax_header(pax, *entry);
+				if(entry->name.ends_with('/'))
+					entry->name.pop_back();
+				if(entry->type != '1')
+					entry->link.clear();
+				else
+					entry->size = 0;  // Some tars record the target's
+
+				into    = {std::move(entry->name), entry->type == '5' ? 0 : entry->size, entry->mtime, entry->type == '5', std::move(entry->link)};
+				left    = into.size;
+				padding = tar_padding(entry->size);
+				if(into.directory)  // Those with content are GNU dumpdirs, of no use here
+					padding += entry->size;
+				return 0;
+
+			default:  // Symbolic links, devices, global pax records, ...
+				if(!skip(entry->size + tar_padding(entry->size)))
+					return cut_off();
+				long_name.reset();
+				long_link.reset();
+				pax.clear();
+				break;
+		}
+	}
+}
+
+std::optional<std::pair<const char *, std::size_t>> tar_reader::content() {
+	if(!left)
+		return std::make_pair(static_cast<const char *>(nullptr), std::size_t{});
+
+	const auto piece = decoded.next(static_cast<std::size_t>(std::min<std::uint64_t>(left, SIZE_MAX)));
+	if(!piece || !piece->second) {
+		if(piece)
+			err = E_BAD_ARCHIVE;  // Cut off mid-member
+		return std::nullopt;
+	}
+	left -= piece->second;
+	return piece;
+}
+
+int tar_reader::error() const {
+	return err ? err : decoded.error();
+}
@@ -0,0 +1,79 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include "content_reader.hpp"
+#include "tar.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+
+
+/// Reads a tarball's members in order, as it's decoded on a thread of its own.
+class tar_reader {
+public:
+	struct member {
+		/// /-separated, directories' without the trailing slash.
+		std::string name;
+		std::uint64_t size;
+		std::int64_t mtime;
+		bool directory;
+		/// Set for hard links: the name of the earlier member with the same content.
+		std::string link;
+	};
+
+private:
+	content_reader decoded;
+	/// Of the current member's content, and the padding after it.
+	std::uint64_t left, padding;
+	/// Set if the tarball ends mid-member.
+	int err;
+
+	/// Return value: whether there were len more bytes to copy into into.
+	bool take(char * into, std::size_t len);
+	/// Return value: whether there were len more bytes to skip.
+	bool skip(std::uint64_t len);
+
+
+public:
+	/// Start decoding on a thread of its own with the specified function, which writes the whole tarball into the stream and returns an E_* error or 0.
+	tar_reader(std::function<int(std::ostream &)> decode);
+	tar_reader(const tar_reader &) = delete;
+	tar_reader(tar_reader &&)      = delete;
+
+	/// Skip what's left of the current member, then read the next file, directory or hard link, skipping other kinds of entries.
+	///
+	/// Return value: 0, E_END_ARCHIVE once the whole stream's been decoded, or an error: E_BAD_ARCHIVE if it's not a tarball,
+	/// or has a long name or pax record past tar_max_record_size, or whatever decoding failed with.
+	int next(member & into);
+
+	/// Return value: the next piece of the current member's content, empty at its end, or nullopt on error, see error().
+	std::optional<std::pair<const char *, std::size_t>> content();
+
+	/// Return value: what reading the tarball failed with, if anything yet.
+	int error() const;
+};
@@ -30,14 +30,30 @@
 #define WCX_PLUGIN_EXPORTS
 #include "wcxapi.h"
 
+#include "autotune.hpp"
+#include "batch.hpp"
 #include "config.hpp"
+#include "dedup.hpp"
+#include "metadata.hpp"
 #include "pack_data.hpp"
+#include "sparse.hpp"
+#include "tar.hpp"
+#include "transcode.hpp"
 #include "unpack_data.hpp"
 #include "util.hpp"
+#include <algorithm>
 #include <cstdio>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 #include <zstd/zstd.h>
 
 
@@ -46,7 +62,7 @@ static tProcessDataProc data_process_callback = nullptr;
 
 
 extern "C" WCX_API HANDLE STDCALL OpenArchive(tOpenArchiveData * ArchiveData) {
-	auto out = new(std::nothrow) unarchive_data(ArchiveData->ArcName);
+	auto out = new(std::nothrow) unarchive_data(ArchiveData->ArcName, configuration{});
 	if(!out)
 		ArchiveData->OpenResult = E_NO_MEMORY;
 	return out;
@@ -67,19 +83,30 @@ static void read_header_set_sizes(tHeaderDataEx * HeaderDataEx, std::uint64_t pa
 template <class HD>
 static int read_header(HANDLE hArcData, HD * HeaderData) {
 	auto & ctx = *static_cast<unarchive_data *>(hArcData);
+	if(ctx.lists_members()) {
+		if(const auto err = ctx.next_member())
+			return err;
+
+		const auto & member = ctx.current_member();
+		std::memset(HeaderData, 0, sizeof(*HeaderData));
+		std::strncpy(HeaderData->ArcName, ctx.derive_archive_name(), sizeof(HeaderData->ArcName) - 1);
+		std::strncpy(HeaderData->FileName, member.name.c_str(), sizeof(HeaderData->FileName) - 1);
+		std::replace(std::begin(HeaderData->FileName), std::end(HeaderData->FileName), '/', '\\');
+		read_header_set_sizes(HeaderData, member.size, member.size);  // Not compressed separately
+		HeaderData->FileAttr = member.directory ? FILE_ATTRIBUTE_DIRECTORY : 0;
+		HeaderData->FileTime = totalcmd_time(unix_to_filetime(member.mtime));
+		return 0;
+	}
+
 	if(ctx.file_shown)
 		return E_END_ARCHIVE;
 
-	// std::uint64_t unpacked_size = ctx.unpacked_size();
-	// if(unpacked_size == 0)
-	// 	unpacked_size = -1;
-
+	// All from the metadata frame, if any, read in one go; otherwise guessed from the archive itself
 	std::memset(HeaderData, 0, sizeof(*HeaderData));
 	std::strncpy(HeaderData->ArcName, ctx.derive_archive_name(), sizeof(HeaderData->ArcName) - 1);
 	std::strncpy(HeaderData->FileName, ctx.derive_contained_name().c_str(), sizeof(HeaderData->FileName) - 1);
-	// read_header_set_sizes(HeaderData, ctx.size, unpacked_size);
-	read_header_set_sizes(HeaderData, ctx.size, ctx.size);
-	HeaderData->FileTime = totalcmd_time(ctx.mtime);
+	read_header_set_sizes(HeaderData, ctx.size, ctx.unpacked_size().value_or(ctx.size));
+	HeaderData->FileTime = totalcmd_time(ctx.original_mtime().value_or(ctx.mtime));
 	ctx.file_shown       = true;
 	return 0;
 }
@@ -93,23 +120,45 @@ extern "C" WCX_API int STDCALL ReadHeaderEx(HANDLE hArcData, tHeaderDataEx * Hea
 }
 
 extern "C" WCX_API int STDCALL ProcessFile(HANDLE hArcData, int Operation, char * DestPath, char * DestName) {
+	auto & ctx = *static_cast<unarchive_data *>(hArcData);
+	if(!ctx.data_process_callback)
+		ctx.data_process_callback = data_process_callback;
+
+	if(ctx.lists_members()) {
+		std::string path;
+		if(DestPath)
+			path = DestPath;
+		if(DestName)
+			path += DestName;
+
+		switch(Operation) {
+			case PK_TEST:
+				return ctx.unpack_member(nullptr);
+			case PK_EXTRACT:
+				return ctx.unpack_member(path.c_str());
+		}
+		return 0;  // Skipped by the next ReadHeader()
+	}
+
 	switch(Operation) {
 		case PK_SKIP:
 			break;
-		case PK_TEST:
-			break;
+		case PK_TEST: {
+			null_streambuf nothing;
+			std::ostream out(&nothing);
+			return ctx.unpack(out);
+		} break;
 		case PK_EXTRACT: {
-			auto & ctx = *static_cast<unarchive_data *>(hArcData);
-			if(!ctx.data_process_callback)
-				ctx.data_process_callback = data_process_callback;
 
 			std::string path;
 			if(DestPath)
 				path = DestPath;
 			path += DestName;
 
-			std::ofstream out(path, std::ios::binary);
-			return ctx.unpack(out);
+			const auto err = ctx.unpack_to(path.c_str());
+			if(const auto mtime = ctx.original_mtime(); !err && mtime)
+				set_file_mtime(path.c_str(), *mtime);
+			return err;
 		} break;
 	}
 
@@ -122,33 +171,73 @@ extern "C" WCX_API int STDCALL CloseArchive(HANDLE hArcData) {
 }
 
 
-extern "C" WCX_API int STDCALL PackFiles(char * PackedFile, char *, char * SrcPath, char * AddList, int Flags) {
-	if(/*Flags & PK_PACK_SAVE_PATHS ||*/ Flags & PK_PACK_ENCRYPT)
-		return E_NOT_SUPPORTED;
+/// Compress a file that fits in memory with a single ZSTD_compress2() call.
+static int pack_whole(archive_data & ctx, std::istream & in, std::size_t size, std::ostream & out, const char * progress_name) {
+	auto in_buffer = std::make_unique<char[]>(size);
+	if(!in.read(in_buffer.get(), size))
+		return E_EREAD;
+
+	const auto out_buf_size = ctx.whole_bound(size);
+	auto out_buffer         = std::make_unique<char[]>(out_buf_size);
+
+	const auto [errored, written] = ctx.compress_whole(in_buffer.get(), size, out_buffer.get(), out_buf_size);
+	if(errored)
+		return E_EWRITE;
+
+	out.write(out_buffer.get(), written);
+	if(!out)
+		return E_EWRITE;
 
+	if(data_process_callback && !data_process_callback(const_cast<char *>(progress_name), size))
+		return E_EABORTED;
+	return 0;
+}
+
+/// Compress everything left in the stream into the current frame, reporting progress if progress_name is not nullptr.
+static int pack_stream(archive_data & ctx, std::istream & in, std::ostream & out, const char * progress_name) {
 	const auto in_buf_size  = ZSTD_CStreamInSize();
 	const auto out_buf_size = ZSTD_CStreamOutSize();
 	auto in_buffer          = std::make_unique<char[]>(in_buf_size);
 	auto out_buffer         = std::make_unique<char[]>(out_buf_size);
 
-	// We don't specify PK_CAPS_MULTIPLE in GetPackerCaps() so we'll only ever get one file in AddList.
-	std::string path = SrcPath;
-	path += AddList;
+	for(std::size_t in_buf_off = 0;;) {
+		in.read(in_buffer.get() + in_buf_off, in_buf_size - in_buf_off);
+		const auto read = in.gcount() + std::exchange(in_buf_off, 0);
+		if(read == 0)
+			break;
 
-	{
-		archive_data ctx;
-		std::ifstream in(path, std::ios::binary);
-		std::ofstream out(PackedFile, std::ios::binary | std::ios::trunc);
+		const auto [errored, taken_written] = ctx.add_data(in_buffer.get(), read, out_buffer.get(), out_buf_size);
+		const auto [taken, written]         = taken_written;
+		if(errored)
+			return E_EWRITE;
+
+		out.write(out_buffer.get(), written);
 		if(!out)
-			return E_ECREATE;
+			return E_EWRITE;
 
-		for(std::size_t in_buf_off = 0;;) {
-			in.read(in_buffer.get() + in_buf_off, in_buf_size - in_buf_off);
-			const auto read = in.gcount() + std::exchange(in_buf_off, 0);
-			if(read == 0)
-				break;
+		if(progress_name && data_process_callback && !data_process_callback(const_cast<char *>(progress_name), taken))
+			return E_EABORTED;
 
-			const auto [errored, taken_written] = ctx.add_data(in_buffer.get(), read, out_buffer.get(), out_buf_size);
+		in_buf_off = read - taken;
+		std::memmove(in_buffer.get(), in_buffer.get() + taken, in_buf_off);
+	}
+	return 0;
+}
+
+/// Compress everything decoded from the source into the current frame, reporting progress in bytes of the source.
+static int pack_transcoded(archive_data & ctx, transcode_source & in, std::ostream & out, const char * progress_name) {
+	const auto out_buf_size = ZSTD_CStreamOutSize();
+	auto out_buffer         = std::make_unique<char[]>(out_buf_size);
+
+	for(;;) {
+		const auto chunk = in.next();
+		if(!chunk)
+			return in.error();
+		if(!chunk->size)
+			return 0;
+
+		for(std::size_t pos = 0; pos != chunk->size;) {
+			const auto [errored, taken_written] = ctx.add_data(chunk->data + pos, chunk->size - pos, out_buffer.get(), out_buf_size);
 			const auto [taken, written]         = taken_written;
 			if(errored)
 				return E_EWRITE;
@@ -156,27 +245,246 @@ extern "C" WCX_API int STDCALL PackFiles(char * PackedFile, char *, char * SrcPa
 			out.write(out_buffer.get(), written);
 			if(!out)
 				return E_EWRITE;
+			pos += taken;
+		}
 
-			if(data_process_callback && !data_process_callback(AddList, taken))
+		if(data_process_callback && !data_process_callback(const_cast<char *>(progress_name), chunk->progress))
+			return E_EABORTED;
+	}
+}
+
+static int finish_frame(archive_data & ctx, std::ostream & out) {
+	const auto out_buf_size = ZSTD_CStreamOutSize();
+	auto out_buffer         = std::make_unique<char[]>(out_buf_size);
+
+	for(;;) {
+		const auto [errored, finished, written] = ctx.finish(out_buffer.get(), out_buf_size);
+		out.write(out_buffer.get(), written);
+		if(!out)
+			return E_EWRITE;
+		if(errored)
+			return E_EWRITE;
+		else if(finished)
+			break;
+	}
+	return 0;
+}
+
+static int pack_string(archive_data & ctx, const std::string & data, std::ostream & out) {
+	std::istringstream in(data);
+	return pack_stream(ctx, in, out, nullptr);
+}
+
+/// Pack the specified files and directories as tar members, then the end-of-archive blocks in a frame of their own, recorded in the metadata.
+///
+/// With deduplicate, files with the same content as an earlier one are packed as hard links to it.
+static int pack_tarball(archive_data & ctx, const std::string & src_path, const std::vector<std::string> & names, const char * sub_path, bool save_paths,
+                        bool deduplicate, std::ostream & out) {
+	std::string prefix = sub_path ? sub_path : "";
+	if(!prefix.empty() && prefix.back() != '\\')
+		prefix += '\\';
+
+	std::vector<std::optional<std::size_t>> duplicates(names.size());
+	if(deduplicate) {
+		std::vector<std::string> paths;
+		std::vector<std::optional<std::uint64_t>> sizes;
+		for(auto && name : names) {
+			std::error_code ec;
+			paths.emplace_back(src_path + name);
+			if(!name.ends_with('\\') && std::filesystem::is_regular_file(paths.back(), ec))
+				sizes.emplace_back(std::filesystem::file_size(paths.back(), ec));
+			else
+				sizes.emplace_back();
+		}
+		duplicates = find_duplicates(paths, sizes, ctx.threads());
+	}
+
+	std::vector<std::string> members(names.size());
+	// Links name what they link to, so only while it's the last member with that name, which it might not be when paths aren't saved
+	std::unordered_map<std::string, std::size_t> last_named;
+	for(std::size_t i = 0; i != names.size(); ++i) {
+		const auto & name = names[i];
+		std::error_code ec;
+		const auto path      = src_path + name;
+		const auto directory = name.ends_with('\\') || std::filesystem::is_directory(path, ec);
+		if(directory && !save_paths)
+			continue;
+
+		auto & member = members[i];
+		member        = save_paths ? name : name.substr(name.find_last_of('\\') + 1);
+		member        = prefix + member;
+		std::replace(member.begin(), member.end(), '\\', '/');
+		const auto original = duplicates[i];
+		const auto linkable = original && last_named[lowercase(members[*original])] == *original && lowercase(member) != lowercase(members[*original]);
+		last_named[lowercase(member)] = i;
+
+		std::int64_t mtime{};
+		if(const auto ft = file_mtime(path.c_str()))
+			mtime = unix_time(*ft);
+
+		if(directory) {
+			if(const auto err = pack_string(ctx, tar_header(member, 0, mtime, true), out))
+				return err;
+			continue;
+		}
+
+		const auto size = std::filesystem::file_size(path, ec);
+		if(linkable) {
+			if(const auto err = pack_string(ctx, tar_link_header(member, members[*original], mtime), out))
+				return err;
+			if(data_process_callback && !data_process_callback(const_cast<char *>(name.c_str()), size))
 				return E_EABORTED;
+			continue;
+		}
+
+		sparse_ifstream in(path);
+		if(ec || !in)
+			return E_EOPEN;
+
+		if(const auto err = pack_string(ctx, tar_header(member, size, mtime, false), out))
+			return err;
+		const auto before = ctx.stats.compressed_bytes + ctx.stats.stored_bytes;
+		if(const auto err = pack_stream(ctx, in, out, name.c_str()))
+			return err;
+		if(ctx.stats.compressed_bytes + ctx.stats.stored_bytes - before != size)  // Changed while packing; the header's already out
+			return E_EREAD;
+		if(const auto err = pack_string(ctx, std::string(tar_padding(size), '\0'), out))
+			return err;
+	}
+
+	if(const auto err = finish_frame(ctx, out))
+		return err;
+	ctx.meta.tar_trailer = out.tellp();
+	if(const auto err = pack_string(ctx, std::string(tar_trailer_size, '\0'), out))
+		return err;
+	return finish_frame(ctx, out);
+}
+
+/// Return value: ID of the dictionary the frame at the specified offset was compressed with, 0 if none.
+static unsigned int dictionary_id_at(const char * fname, std::uint64_t offset) {
+	std::ifstream in(fname, std::ios::binary);
+	char header[ZSTD_FRAMEHEADERSIZE_MAX];
+	in.seekg(offset).read(header, sizeof(header));
+	return ZSTD_getDictID_fromFrame(header, in.gcount());
+}
+
+extern "C" WCX_API int STDCALL PackFiles(char * PackedFile, char * SubPath, char * SrcPath, char * AddList, int Flags) {
+	if(Flags & PK_PACK_ENCRYPT)
+		return E_NOT_SUPPORTED;
+
+	std::vector<std::string> names;
+	for(auto name = AddList; *name; name += std::strlen(name) + 1)
+		names.emplace_back(name);
+
+	// Existing archives are added to: new frames go at the end, or in place of a tarball's end-of-archive blocks
+	std::error_code ec;
+	const auto archive_size = std::filesystem::file_size(PackedFile, ec);
+	const auto appending    = !ec && archive_size;
+	const auto existing     = appending ? archive_metadata::from_file(PackedFile) : std::nullopt;
+
+	// A plain .zst holds a single file, more go into a tarball in it; one that already holds a single file can't take more
+	const auto tarball = is_tarball_name(PackedFile) || (existing ? is_tarball_name(existing->first.name) : names.size() != 1);
+	if(names.size() != 1 && !tarball)
+		return E_NOT_SUPPORTED;
+
+	const configuration cfg;
 
-			in_buf_off = read - taken;
+	// Other compressed formats can be packed as what they contain, decoded as they're packed
+	auto format = file_format::unknown;
+	if(!tarball && cfg.transcode)
+		format = detect_format((SrcPath + names.front()).c_str());
+	const auto transcoding = format == file_format::gzip || format == file_format::xz || format == file_format::lz4;
+
+	std::uint64_t size{};
+	auto size_known = !transcoding;
+	for(auto && name : names) {
+		size += std::filesystem::is_regular_file(SrcPath + name, ec) ? std::filesystem::file_size(SrcPath + name, ec) : 0;
+		size_known &= !ec;
+	}
+
+	{
+		auto contained_name = tarball ? guess_contained_name(PackedFile) : transcoding ? transcoded_name(names.front()) : names.front();
+		// Tarballs in a plain .zst are named as it is, with .tar, so they're listed as tarballs, and their members with tar_members
+		if(tarball && !is_tarball_name(contained_name))
+			contained_name = existing ? existing->first.name : contained_name + ".tar";
+		// Before the archive claims its share of the threads, so the trials get all of it
+		const auto tuned = size_known ? autotune(SrcPath, names, contained_name.c_str(), cfg) : std::nullopt;
+		archive_data ctx(contained_name.c_str(), cfg, size_known ? size : 0);
+		if(tuned)
+			ctx.tune(tuned->level, tuned->strategy);
+		std::uint64_t start{};
+		std::string old_trailer;
+		if(appending) {
+			// A plain .zst holds a single file: only more of the same one goes on its end
+			if(!tarball && !(existing && lowercase(existing->first.name) == lowercase(ctx.meta.name)))
+				return E_NOT_SUPPORTED;
+			const auto sizes_fit = ctx.append_to(existing ? &existing->first : nullptr, existing ? existing->second : 0);
+			// Without knowing where the end-of-archive blocks are, nor being able to record where the new ones are, it'd all have to be decompressed
+			if(tarball && !(existing && existing->first.tar_trailer && sizes_fit))
+				return E_NOT_SUPPORTED;
+			// The new frames need to decompress with what the rest was compressed with
+			if(existing && (ctx.meta.patch_from_size != existing->first.patch_from_size || ctx.meta.patch_from_hash != existing->first.patch_from_hash))
+				return E_EOPEN;
+			if(ctx.dictionary_id() != dictionary_id_at(PackedFile, existing ? existing->second : 0))
+				return E_NOT_SUPPORTED;
+
+			start = tarball ? *existing->first.tar_trailer : archive_size;
+			if(start > archive_size)
+				return E_BAD_ARCHIVE;
+			// Put back if anything fails
+			std::ifstream old(PackedFile, std::ios::binary);
+			old_trailer.resize(archive_size - start);
+			old.seekg(start).read(old_trailer.data(), old_trailer.size());
+		} else if(tarball)
+			ctx.meta.tar_trailer = 0;
+		else if(const auto mtime = file_mtime((SrcPath + names.front()).c_str()))
+			ctx.meta.mtime = static_cast<std::uint64_t>(mtime->dwHighDateTime) << 32 | mtime->dwLowDateTime;
+
+		std::fstream out(PackedFile, std::ios::binary | std::ios::in | std::ios::out | (appending ? std::ios::openmode{} : std::ios::trunc));
+		if(!out)
+			return appending ? E_EOPEN : E_ECREATE;
+		out.seekp(start);
+
+		int err;
+		if(tarball)
+			err = pack_tarball(ctx, SrcPath, names, SubPath, Flags & PK_PACK_SAVE_PATHS, cfg.deduplicate, out);
+		else if(transcoding) {
+			transcode_source in((SrcPath + names.front()).c_str(), format, cfg);
+			if(!(err = pack_transcoded(ctx, in, out, names.front().c_str())))
+				err = finish_frame(ctx, out);
+		} else {
+			// Small files skip the per-chunk overhead of streaming
+			sparse_ifstream in(SrcPath + names.front());
+			if(size_known && size <= cfg.one_shot_threshold * 1024 * 1024)
+				err = pack_whole(ctx, in, size, out, names.front().c_str());
+			else if(!(err = pack_stream(ctx, in, out, names.front().c_str())))
+				err = finish_frame(ctx, out);
 		}
 
-		for(;;) {
-			const auto [errored, finished, written] = ctx.finish(out_buffer.get(), out_buf_size);
-			out.write(out_buffer.get(), written);
-			if(!out)
-				return E_EWRITE;
-			if(errored)
-				return E_EWRITE;
-			else if(finished)
-				break;
+		const std::uint64_t end = out.tellp();
+		if(!err) {
+			// Now that the sizes are known; the frame at the start was padded to fit them
+			const auto header = ctx.final_header();
+			if(!header.empty() && !out.seekp(0).write(header.data(), header.size()))
+				err = E_EWRITE;
 		}
+		out.close();
+
+		if(err) {
+			if(appending) {
+				std::filesystem::resize_file(PackedFile, start, ec);
+				std::ofstream(PackedFile, std::ios::binary | std::ios::app) << old_trailer;
+			}
+			return err;
+		}
+		if(appending && end < archive_size)
+			std::filesystem::resize_file(PackedFile, end, ec);
 	}
 
+	// Files before the directories they're in
 	if(Flags & PK_PACK_MOVE_FILES)
-		std::remove(path.c_str());
+		for(auto itr = names.rbegin(); itr != names.rend(); ++itr)
+			std::filesystem::remove(SrcPath + *itr, ec);
 
 	return 0;
 }
@@ -195,11 +503,44 @@ extern "C" WCX_API BOOL STDCALL CanYouHandleThisFile(char * FileName) {
 }
 
 extern "C" WCX_API int STDCALL GetPackerCaps() {
-	return PK_CAPS_NEW | PK_CAPS_OPTIONS | PK_CAPS_MEMPACK | PK_CAPS_BY_CONTENT | PK_CAPS_SEARCHTEXT;
+	return PK_CAPS_NEW | PK_CAPS_MODIFY | PK_CAPS_MULTIPLE | PK_CAPS_OPTIONS | PK_CAPS_MEMPACK | PK_CAPS_BY_CONTENT | PK_CAPS_SEARCHTEXT;
+}
+
+/// Run the specified function on a thread of its own, dispatching this one's window messages meanwhile, so Total Commander doesn't freeze.
+static void run_responsively(const std::function<void()> & func) {
+	const auto done = CreateEvent(nullptr, true, false, nullptr);
+	if(!done) {
+		func();
+		return;
+	}
+
+	std::thread worker([&] {
+		func();
+		SetEvent(done);
+	});
+	std::optional<WPARAM> quit;
+	while(MsgWaitForMultipleObjects(1, &done, false, INFINITE, QS_ALLINPUT) == WAIT_OBJECT_0 + 1)
+		for(MSG msg; PeekMessage(&msg, nullptr, 0, 0, PM_REMOVE);)
+			if(msg.message == WM_QUIT)
+				quit = msg.wParam;
+			else {
+				TranslateMessage(&msg);
+				DispatchMessage(&msg);
+			}
+	worker.join();
+	CloseHandle(done);
+	if(quit)  // Not ours to take
+		PostQuitMessage(static_cast<int>(*quit));
 }
 
 extern "C" WCX_API void STDCALL ConfigurePacker(HWND Parent, HINSTANCE) {
-	configuration{};  // Force creation if nonexistant
+	if(configuration cfg; cfg.rewritable) {
+		if(cfg.calibrate) {
+			run_responsively([&] { calibrate(cfg); });
+			cfg.calibrate = false;
+		}
+		cfg.save();  // Force creation if nonexistant, and add new settings
+	}
 
 	std::string totalcmd_editor, totalcmd_editor_arguments;
 	if(const auto totalcmd_cfg_f = totalcmd_config_file(); !totalcmd_cfg_f.empty())
@@ -243,9 +584,28 @@ extern "C" WCX_API void STDCALL ConfigurePacker(HWND Parent, HINSTANCE) {
 			MessageBox(Parent, ("Please edit file \"" + cfg_f + "\".").c_str(), "totalcmd-zstd plugin configuration", MB_ICONWARNING | MB_OK);
 }
 
-extern "C" WCX_API HANDLE STDCALL StartMemPack(int, char *) {
+/// For rundll32: benchmark this machine and write the recommended settings into the configuration, as with "calibrate".
+extern "C" WCX_API void STDCALL Calibrate(HWND Parent, HINSTANCE, LPSTR, int) {
+	configuration cfg;
+	const auto trials = calibrate(cfg);
+	cfg.calibrate     = false;
+	const auto saved  = cfg.rewritable && cfg.save();
+
+	std::ostringstream report;
+	report.precision(3);
+	for(auto && trial : trials)
+		report << "Level " << trial.level << (trial.strategy ? " with strategy " + std::to_string(trial.strategy) : "") << ": " << trial.speed << " MB/s per thread, ratio " << trial.ratio
+		       << '\n';
+	report << "\nDisk: " << cfg.disk_speed << " MB/s\nRecommended level: " << cfg.compression_level << (saved ? ", written to " : ", but couldn't write ") << config_file() << '.';
+	MessageBox(Parent, report.str().c_str(), "totalcmd-zstd calibration", MB_OK);
+}
+
+extern "C" WCX_API HANDLE STDCALL StartMemPack(int, char * FileName) {
 	// This has the added benefit of 0=error, so we'll never NPE
-	return new(std::nothrow) archive_data;
+	const auto ret = new(std::nothrow) archive_data(FileName, configuration{});
+	if(ret)
+		ret->stream();
+	return ret;
 }
 
 extern "C" WCX_API int STDCALL PackToMem(HANDLE hMemPack, char * BufIn, int InLen, int * Taken, char * BufOut, int OutLen, int * Written, int) {
@@ -273,3 +633,85 @@ extern "C" WCX_API int STDCALL DoneMemPack(HANDLE hMemPack) {
 extern "C" WCX_API int STDCALL GetBackgroundFlags(void) {
 	return BACKGROUND_UNPACK | BACKGROUND_PACK | BACKGROUND_MEMPACK;
 }
+
+
+/// Not part of the WCX interface, for viewers built on the plugin: read up to Size bytes of the content of an archive opened with OpenArchive(),
+/// continuing from where the last call left off, into Buffer; Read is set to how many, fewer than Size only at the end.
+/// Only as much as is read, and a few buffers more, is decoded, so showing the start of a large archive is quick.
+///
+/// Return value: 0, or an error as from ProcessFile().
+extern "C" WCX_API int STDCALL ReadArchiveContent(HANDLE hArcData, char * Buffer, int Size, int * Read) {
+	std::size_t read;
+	const auto err = static_cast<unarchive_data *>(hArcData)->read_content(Buffer, std::max(Size, 0), read);
+	*Read          = static_cast<int>(read);
+	return err;
+}
+
+
+/// Not part of the WCX interface: called by SearchArchive() with the index of the pattern found and its offset in the content.
+/// Return 0 to stop searching.
+typedef int(STDCALL * tSearchFoundProc)(int Pattern, unsigned long long Offset);
+
+/// Not part of the WCX interface, for tools built on the plugin: find the PatternCount NUL-terminated Patterns in the content of the archive
+/// without extracting it, on the thread budget's share of threads for archives with multiple frames.
+///
+/// Return value: 0, E_EABORTED if Found returned 0, or an error as from ProcessFile().
+extern "C" WCX_API int STDCALL SearchArchive(char * ArcName, char ** Patterns, int PatternCount, tSearchFoundProc Found) {
+	unarchive_data ctx(ArcName, configuration{});
+	const pattern_matcher matcher({Patterns, Patterns + std::max(PatternCount, 0)});
+	return ctx.search(matcher, [&](std::size_t pattern, std::uint64_t offset) { return Found(static_cast<int>(pattern), offset) != 0; });
+}
+
+
+/// Not part of the WCX interface: called by ProcessArchives() with the index of each archive as it's done and 0 or the error it failed with,
+/// one at a time. Return 0 to leave the archives not yet started unprocessed.
+typedef int(STDCALL * tBatchDoneProc)(int Index, int Result);
+
+/// Not part of the WCX interface, for tools built on the plugin: test the ArcCount ArcNames, or extract them into DestPath if it's not nullptr,
+/// several at once, see process_archives(). Done may be nullptr.
+///
+/// Return value: 0, or the error of the first archive that failed, as from ProcessFile().
+extern "C" WCX_API int STDCALL ProcessArchives(char ** ArcNames, int ArcCount, char * DestPath, tBatchDoneProc Done) {
+	const auto results = process_archives({ArcNames, ArcNames + std::max(ArcCount, 0)}, DestPath,
+	                                      [&](std::size_t index, int err) { return !Done || Done(static_cast<int>(index), err) != 0; });
+	const auto failed  = std::find_if(results.begin(), results.end(), [](auto err) { return err != 0; });
+	return failed == results.end() ? 0 : *failed;
+}
+
+/// For rundll32: "test archive..." or "extract destination archive...", with quoted arguments for paths with spaces.
+extern "C" WCX_API void STDCALL Batch(HWND Parent, HINSTANCE, LPSTR CmdLine, int) {
+	std::vector<std::string> args;
+	for(const char * cur = CmdLine ? CmdLine : ""; *cur;) {
+		if(*cur == ' ' || *cur == '\t') {
+			++cur;
+			continue;
+		}
+
+		std::string arg;
+		for(bool quoted = false; *cur && (quoted || (*cur != ' ' && *cur != '\t')); ++cur)
+			if(*cur == '"')
+				quoted = !quoted;
+			else
+				arg += *cur;
+		args.emplace_back(std::move(arg));
+	}
+
+	const auto extract = !args.empty() && args[0] == "extract";
+	if(args.size() < (extract ? 3u : 2u) || (!extract && args[0] != "test")) {
+		MessageBox(Parent, "Usage: test archive...\n       extract destination archive...", "totalcmd-zstd batch", MB_ICONWARNING | MB_OK);
+		return;
+	}
+
+	const std::vector<std::string> archives(args.begin() + (extract ? 2 : 1), args.end());
+	const auto results = process_archives(archives, extract ? args[1].c_str() : nullptr, [](auto, auto) { return true; });
+
+	std::ostringstream report;
+	std::size_t failed = 0;
+	for(std::size_t i = 0; i != results.size(); ++i)
+		if(results[i]) {
+			report << archives[i] << ": error " << results[i] << '\n';
+			++failed;
+		}
+	report << (results.size() - failed) << " of " << results.size() << " archives " << (extract ? "extracted" : "tested") << " successfully.";
+	MessageBox(Parent, report.str().c_str(), "totalcmd-zstd batch", failed ? MB_ICONWARNING | MB_OK : MB_OK);
+}
@@ -0,0 +1,273 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "transcode.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <lz4frame.h>
+#include <lzma.h>
+#include <utility>
+#include <wcxhead.h>
+#define ZLIB_CONST
+#include <zlib.h>
+#include <zstd/zstd.h>
+
+
+/// Decoded data is handed over in chunks of this size.
+static const std::size_t chunk_size = 1024 * 1024;
+
+
+namespace {
+	/// One of the formats' decoders, behind the same interface as ZSTD_decompressStream().
+	class stream_decoder {
+	public:
+		/// Whether the input so far ends at the end of a stream.
+		bool ended = false;
+
+		virtual ~stream_decoder() = default;
+
+		/// Decode as much of the input as fits into the output. last is set once the whole file's been passed in.
+		///
+		/// Return value: 0, or E_BAD_DATA or E_NO_MEMORY.
+		virtual int step(ZSTD_inBuffer & in, ZSTD_outBuffer & out, bool last) = 0;
+	};
+
+	class gzip_decoder : public stream_decoder {
+	private:
+		z_stream stream{};
+		bool initialised;
+
+	public:
+		gzip_decoder() : initialised(inflateInit2(&stream, 16 + MAX_WBITS) == Z_OK) {}  // +16: gzip wrapper, not zlib
+		~gzip_decoder() override {
+			if(initialised)
+				inflateEnd(&stream);
+		}
+
+		int step(ZSTD_inBuffer & in, ZSTD_outBuffer & out, bool) override {
+			if(!initialised)
+				return E_NO_MEMORY;
+			if(ended) {
+				// Zeros padding out the last member, as tar and dd leave, end the stream as well; no member starts with one
+				while(in.pos != in.size && !static_cast<const Bytef *>(in.src)[in.pos])
+					++in.pos;
+				if(in.pos == in.size)
+					return 0;
+				inflateReset(&stream);  // Another member follows
+				ended = false;
+			}
+
+			stream.next_in   = static_cast<const Bytef *>(in.src) + in.pos;
+			stream.avail_in  = std::min<std::size_t>(in.size - in.pos, UINT_MAX);
+			stream.next_out  = static_cast<Bytef *>(out.dst) + out.pos;
+			stream.avail_out = std::min<std::size_t>(out.size - out.pos, UINT_MAX);
+			const auto res   = inflate(&stream, Z_NO_FLUSH);
+			in.pos           = stream.next_in - static_cast<const Bytef *>(in.src);
+			out.pos          = stream.next_out - static_cast<Bytef *>(out.dst);
+
+			switch(res) {
+				case Z_STREAM_END:
+					ended = true;
+					[[fallthrough]];
+				case Z_OK:
+				case Z_BUF_ERROR:  // No progress possible, not an error
+					return 0;
+				case Z_MEM_ERROR:
+					return E_NO_MEMORY;
+				default:
+					return E_BAD_DATA;
+			}
+		}
+	};
+
+	class xz_decoder : public stream_decoder {
+	private:
+		lzma_stream stream = LZMA_STREAM_INIT;
+		lzma_ret initialised;
+
+	public:
+		xz_decoder(std::uint64_t memory_limit) : initialised(lzma_stream_decoder(&stream, std::max<std::uint64_t>(memory_limit, 1), LZMA_CONCATENATED)) {}
+		~xz_decoder() override { lzma_end(&stream); }
+
+		int step(ZSTD_inBuffer & in, ZSTD_outBuffer & out, bool last) override {
+			if(initialised != LZMA_OK)
+				return E_NO_MEMORY;
+
+			stream.next_in   = static_cast<const std::uint8_t *>(in.src) + in.pos;
+			stream.avail_in  = in.size - in.pos;
+			stream.next_out  = static_cast<std::uint8_t *>(out.dst) + out.pos;
+			stream.avail_out = out.size - out.pos;
+			const auto res   = lzma_code(&stream, last ? LZMA_FINISH : LZMA_RUN);  // Concatenated streams only end on LZMA_FINISH
+			in.pos           = stream.next_in - static_cast<const std::uint8_t *>(in.src);
+			out.pos          = stream.next_out - static_cast<std::uint8_t *>(out.dst);
+
+			switch(res) {
+				case LZMA_STREAM_END:
+					ended = true;
+					[[fallthrough]];
+				case LZMA_OK:
+				case LZMA_BUF_ERROR:
+					return 0;
+				case LZMA_MEM_ERROR:
+				case LZMA_MEMLIMIT_ERROR:  // Dictionary larger than the memory budget
+					return E_NO_MEMORY;
+				default:
+					return E_BAD_DATA;
+			}
+		}
+	};
+
+	class lz4_decoder : public stream_decoder {
+	private:
+		LZ4F_dctx * ctx = nullptr;
+		LZ4F_errorCode_t initialised;
+
+	public:
+		lz4_decoder() : initialised(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION)) {}
+		~lz4_decoder() override { LZ4F_freeDecompressionContext(ctx); }
+
+		int step(ZSTD_inBuffer & in, ZSTD_outBuffer & out, bool) override {
+			if(LZ4F_isError(initialised))
+				return E_NO_MEMORY;
+
+			auto in_len    = in.size - in.pos;
+			auto out_len   = out.size - out.pos;
+			const auto res = LZ4F_decompress(ctx, static_cast<char *>(out.dst) + out.pos, &out_len, static_cast<const char *>(in.src) + in.pos, &in_len, nullptr);
+			if(LZ4F_isError(res))
+				return E_BAD_DATA;
+
+			in.pos += in_len;
+			out.pos += out_len;
+			if(in_len || out_len)  // Called again at the end, it'd ask for the next frame's header
+				ended = res == 0;
+			return 0;
+		}
+	};
+}
+
+
+transcode_source::transcode_source(const char * fname, file_format fmt, const configuration & cfg)
+      : file(CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr)),
+        format(fmt), decoder_memory(0) {
+	const auto depth = std::max<std::size_t>(cfg.readahead_depth, 1);
+	decoded.emplace(depth, chunk_size);
+	if(file == INVALID_HANDLE_VALUE) {
+		decoded->finish(E_EOPEN);
+		return;
+	}
+
+	// Read like unpacking an archive does, and keep as many decoded chunks in flight
+	std::uint64_t file_size{};
+	GetFileSizeEx(file, reinterpret_cast<LARGE_INTEGER *>(&file_size));
+	const auto min_read = cfg.readahead_buffer_min * 1024 * 1024;
+	const auto max_read = cfg.readahead_buffer_max * 1024 * 1024;
+
+	// The decoded chunks come first, then the reads get up to half of what's left of the budget, and the decoder the rest
+	const auto buffers   = depth * chunk_size;
+	const auto available = memory.available();
+	const auto spare     = available > buffers ? available - buffers : 0;
+	const auto read_size = std::clamp(spare / 2 / depth, min_read, max_read);
+	decoder_memory       = spare > depth * read_size ? spare - depth * read_size : 0;
+	reads.emplace(file, file_size, 0, depth, min_read, read_size);
+	memory.reserve(buffers + depth * read_size);
+
+	decoder = std::thread(&transcode_source::decode, this);
+}
+
+transcode_source::~transcode_source() {
+	decoded->stop();
+	if(decoder.joinable())
+		decoder.join();
+
+	reads.reset();  // Cancels the reads still in flight on the handle
+	CloseHandle(file);
+}
+
+void transcode_source::decode() {
+	std::unique_ptr<stream_decoder> dec;
+	switch(format) {
+		case file_format::gzip:
+			dec = std::make_unique<gzip_decoder>();
+			break;
+		case file_format::xz:  // Streams with dictionaries larger than that are refused, not decoded into swap
+			dec = std::make_unique<xz_decoder>(decoder_memory);
+			break;
+		case file_format::lz4:
+			dec = std::make_unique<lz4_decoder>();
+			break;
+		default:
+			return decoded->finish(E_BAD_DATA);
+	}
+
+	ZSTD_inBuffer in{nullptr, 0, 0};
+	bool eof = false;
+	for(auto into = decoded->acquire(); into;) {
+		if(in.pos == in.size && !eof) {
+			const auto read = reads->next();
+			if(!read)
+				return decoded->finish(E_EREAD);
+			eof = !read->second;
+			in  = {read->first, read->second, 0};
+		}
+
+		ZSTD_outBuffer out{into->data, chunk_size, into->size};
+		const auto pre_in = in.pos, pre_out = out.pos;
+		if(const auto error = dec->step(in, out, eof))
+			return decoded->finish(error);
+		into->size = out.pos;
+		into->progress += in.pos - pre_in;
+
+		if(eof && in.pos == pre_in && out.pos == pre_out) {  // All flushed out
+			if(!dec->ended)                                   // Cut off mid-stream
+				return decoded->finish(E_BAD_DATA);
+			if(into->size)
+				decoded->publish();
+			return decoded->finish(0);
+		}
+
+		if(into->size == chunk_size) {
+			decoded->publish();
+			into = decoded->acquire();
+		}
+	}
+}
+
+std::optional<chunk_queue::chunk> transcode_source::next() {
+	return decoded->next();
+}
+
+int transcode_source::error() const {
+	return decoded->error();
+}
+
+
+std::string transcoded_name(const std::string & fname) {
+	static const std::pair<const char *, const char *> extensions[] = {{".gz", ""}, {".xz", ""}, {".lz4", ""}, {".tgz", ".tar"}, {".txz", ".tar"}};
+
+	const auto lowercase_fname = lowercase(fname);
+	for(auto && [extension, replacement] : extensions)
+		if(lowercase_fname.ends_with(extension))
+			return fname.substr(0, fname.size() - std::strlen(extension)) + replacement;
+	return fname;
+}
@@ -0,0 +1,83 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "chunk_queue.hpp"
+#include "config.hpp"
+#include "memory_budget.hpp"
+#include "read_queue.hpp"
+#include "util.hpp"
+#include "worker_pool.hpp"
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <thread>
+
+
+/// Decompresses a gzip, xz or lz4 file on a thread of its own, handing the output over in chunks from a bounded pool,
+/// so it can be packed again as it's decoded, without an intermediate file.
+///
+/// Concatenated streams, as left by appending to one, are decoded one after another, like gzip -d does.
+class transcode_source {
+private:
+	HANDLE file;
+	file_format format;
+	std::optional<read_queue> reads;
+	// Decoding takes up a core, which packing running alongside shouldn't count on
+	worker_share share;
+	memory_reservation memory;
+	/// What's left of the memory budget for the decoder itself.
+	std::uint64_t decoder_memory;
+	/// Chunks' progress is bytes of the source file decoded into them.
+	std::optional<chunk_queue> decoded;
+	std::thread decoder;
+
+	void decode();
+
+
+public:
+	/// Start decoding the specified file, of the specified format.
+	transcode_source(const char * fname, file_format format, const configuration & cfg);
+	/// Stops the decoder if it's not done yet.
+	~transcode_source();
+	transcode_source(const transcode_source &) = delete;
+	transcode_source(transcode_source &&)      = delete;
+
+	/// Wait for the next chunk of decoded data. The previously returned one is recycled.
+	///
+	/// Return value: the chunk, size 0 at the end of the source, or nullopt if decoding failed, see error().
+	std::optional<chunk_queue::chunk> next();
+
+	/// Return value: E_EOPEN, E_EREAD, E_BAD_DATA or E_NO_MEMORY, once next() returned nullopt.
+	int error() const;
+};
+
+/// Return value: the specified file name without its gzip, xz or lz4 extension, or with .tar for .tgz and .txz.
+std::string transcoded_name(const std::string & fname);
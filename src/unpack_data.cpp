@@ -21,160 +21,929 @@
 
 
 #include "unpack_data.hpp"
+#include "checksum.hpp"
+#include "config.hpp"
+#include "memory_budget.hpp"
+#include "metadata.hpp"
+#include "read_queue.hpp"
+#include "sparse.hpp"
+#include "util.hpp"
+#include "worker_pool.hpp"
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <streambuf>
+#include <thread>
+#include <utility>
+#define XXH_STATIC_LINKING_ONLY
+#include <zstd/common/xxhash.h>
 
 
-unarchive_data::unarchive_data(const char * fname)
-      : file_shown(false), mtime({}), size(0), file(fname), fstream(CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
-                                                                                nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr)),
-        iobuf_overlapped({}) {
+/// read_content() decodes at most this many chunks of this size ahead.
+static const constexpr std::size_t content_chunk_size  = 256 * 1024;
+static const constexpr std::size_t content_chunk_depth = 4;
+
+/// Decoded output buffers the verifier may be behind by.
+static const constexpr std::size_t verify_depth = 4;
+
+/// prefetch() reads this much of the start of the archive.
+static const constexpr std::size_t prefetch_size = 1024 * 1024;
+
+/// Archives with windows at least this large are extracted straight into a mapping of the output, if it fits in the address space.
+static const constexpr std::uint64_t mapped_window_min = 16 * 1024 * 1024;
+static const constexpr std::uint64_t mapped_size_max   = sizeof(void *) > 4 ? UINT64_MAX : 1024 * 1024 * 1024;
+
+
+namespace {
+	/// Searches what's written into it instead of keeping it; writes fail once the search's been stopped.
+	class searching_streambuf : public std::streambuf {
+	private:
+		pattern_stream stream;
+		const match_callback & found;
+
+	public:
+		bool stopped = false;
+
+		searching_streambuf(const pattern_matcher & matcher, const match_callback & f) : stream(matcher), found(f) {}
+
+	protected:
+		std::streamsize xsputn(const char_type * data, std::streamsize count) override {
+			if(stopped || !stream.feed(data, count, found))
+				stopped = true;
+			return stopped ? 0 : count;
+		}
+
+		int_type overflow(int_type c) override {
+			if(traits_type::eq_int_type(c, traits_type::eof()))
+				return traits_type::not_eof(c);
+			const auto ch = traits_type::to_char_type(c);
+			return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+		}
+	};
+
+	/// What searching a frame found, offset from its start.
+	struct frame_search {
+		std::vector<std::pair<std::size_t, std::uint64_t>> matches;
+		/// The first and last overlap() bytes of the content, or all of it, for the matches spanning frames.
+		std::string head, tail;
+		std::uint64_t size = 0;
+		int err            = 0;
+		bool done          = false;
+	};
+}
+
+
+/// Return value: content of the reference file the archive was made against, or empty if it's gone or changed.
+///
+/// The one configured for the contained file is tried if the recorded one doesn't match, so the reference can be moved around.
+static std::string load_reference(const archive_metadata & meta, const std::string & contained_name, const configuration & cfg) {
+	for(auto && path : {meta.patch_from, cfg.parameters_for(contained_name.c_str()).patch_from})
+		if(auto ref = read_file(path.c_str()); ref && ref->size() == meta.patch_from_size && XXH64(ref->data(), ref->size(), 0) == meta.patch_from_hash)
+			return std::move(*ref);
+	return {};
+}
+
+
+unarchive_data::unarchive_data(const char * fname, configuration cfg)
+      : file_shown(false), data_process_callback(nullptr), mtime({}), size(0), cfg(std::move(cfg)), file(fname),
+        fstream(CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr)),
+        metadata_read(false), data_start(0), member_pending(false), member_index(0) {
 	if(fstream != INVALID_HANDLE_VALUE) {
 		GetFileTime(fstream, nullptr, nullptr, &mtime);
 		GetFileSizeEx(fstream, reinterpret_cast<LARGE_INTEGER *>(&size));
-		if(!ReadFile(fstream, iobuf, sizeof(iobuf), nullptr, &iobuf_overlapped))
-			if(GetLastError() != ERROR_IO_PENDING) {
-				CloseHandle(fstream);
-				fstream = INVALID_HANDLE_VALUE;
-			}
 	}
 }
 
 unarchive_data::~unarchive_data() {
+	// Before the handle the decoders are reading from goes
+	writers.reset();
+	tar.reset();
+	content.reset();
 	CloseHandle(fstream);
 }
 
+void unarchive_data::prefetch() {
+	if(fstream == INVALID_HANDLE_VALUE)
+		return;
+	const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(size, prefetch_size));
+	auto buffer    = std::make_unique<char[]>(len);
+	read_at(0, buffer.get(), len);
+	read_metadata();
+}
+
 const char * unarchive_data::derive_archive_name() const {
 	return file.c_str() + file.find_last_of("\\/") + 1;
 }
 
-std::string unarchive_data::derive_contained_name() const {
-	std::string lowercase_file;
-	lowercase_file.reserve(file.size());
-	std::transform(file.begin(), file.end(), std::back_inserter(lowercase_file), [](char c) { return std::tolower(c); });
-
-	auto start              = file.find_last_of("\\/") + 1;
-	auto end                = file.rfind('.');
-	auto is_zstd_extension  = lowercase_file.find("zst", end) != std::string::npos;
-	auto is_tzstd_extension = lowercase_file.find("tzst", end) != std::string::npos;
+std::string unarchive_data::derive_contained_name() {
+	if(const auto meta = read_metadata(); meta && !meta->name.empty())
+		return meta->name;
 
-	if(is_tzstd_extension)
-		return file.substr(start, end + 1 - start) + "tar";
-	else if(is_zstd_extension)
-		return file.substr(start, end - start);
-	else
-		return file.substr(start);
+	return guess_contained_name(file);
 }
 
-void unarchive_data::await_iobuf() {
+std::size_t unarchive_data::read_at(std::uint64_t offset, void * into, std::size_t len) {
+	OVERLAPPED overlapped{};
+	overlapped.OffsetHigh = offset >> 32;
+	overlapped.Offset     = offset & 0xFFFFFFFF;
+
 	DWORD read;
-	iobuf_eof = !GetOverlappedResult(fstream, &iobuf_overlapped, &read, true) && GetLastError() == ERROR_HANDLE_EOF;
-	iobuf_len = read;
+	if(!ReadFile(fstream, into, len, nullptr, &overlapped) && GetLastError() != ERROR_IO_PENDING)
+		return 0;
+	if(!GetOverlappedResult(fstream, &overlapped, &read, true))
+		return 0;
+	return read;
+}
 
+const archive_metadata * unarchive_data::read_metadata() {
+	if(!metadata_read && fstream != INVALID_HANDLE_VALUE) {
+		metadata_read = true;
+
+		// Enough for the metadata frame unless the names in it are very long
+		std::string buf(1024, '\0');
+		buf.resize(read_at(0, buf.data(), buf.size()));
+		if(buf.size() >= ZSTD_SKIPPABLEHEADERSIZE && ZSTD_isSkippableFrame(buf.data(), buf.size())) {
+			std::uint32_t skippable_len;
+			std::memcpy(&skippable_len, buf.data() + 4, sizeof(skippable_len));
+			data_start = ZSTD_SKIPPABLEHEADERSIZE + std::uint64_t{skippable_len};
+
+			if(data_start > buf.size() && data_start <= archive_metadata::max_frame_size) {
+				buf.resize(data_start);
+				buf.resize(read_at(0, buf.data(), buf.size()));
+			}
+			if(auto meta = archive_metadata::from_frame(buf.data(), buf.size()))
+				metadata = std::move(meta->first);
+		}
+	}
+	return metadata ? &*metadata : nullptr;
+}
+
+std::optional<FILETIME> unarchive_data::original_mtime() {
+	const auto meta = read_metadata();
+	if(!meta || !meta->mtime)
+		return std::nullopt;
 
-	std::uint64_t offset = (static_cast<std::uint64_t>(iobuf_overlapped.OffsetHigh) << 32) | static_cast<std::uint64_t>(iobuf_overlapped.Offset);
-	offset += iobuf_len;
-	iobuf_overlapped.OffsetHigh = offset >> 32;
-	iobuf_overlapped.Offset     = offset & 0xFFFFFFFF;
+	FILETIME ret;
+	ret.dwHighDateTime = meta->mtime >> 32;
+	ret.dwLowDateTime  = meta->mtime & 0xFFFFFFFF;
+	return ret;
 }
 
-std::uint64_t unarchive_data::unpacked_size() {
+std::optional<std::uint64_t> unarchive_data::unpacked_size() {
 	if(!unpacked_len) {
+		if(const auto meta = read_metadata(); meta && meta->content_size)
+			return unpacked_len = *meta->content_size;
 		if(fstream == INVALID_HANDLE_VALUE)
-			return 0;
-
-		await_iobuf();
+			return std::nullopt;
+
+		// Just the frame header
+		char header[ZSTD_FRAMEHEADERSIZE_MAX];
+		const auto header_len   = read_at(data_start, header, sizeof(header));
+		const auto content_size = ZSTD_getFrameContentSize(header, header_len);
+		if(content_size == ZSTD_CONTENTSIZE_UNKNOWN || content_size == ZSTD_CONTENTSIZE_ERROR)
+			return std::nullopt;
+		unpacked_len = content_size;
+	}
+	return unpacked_len;
+}
 
-		static_assert(sizeof(iobuf) >= ZSTD_FRAMEHEADERSIZE_MAX);
-		unpacked_len = ZSTD_getFrameContentSize(iobuf, iobuf_len);
-		if(*unpacked_len == ZSTD_CONTENTSIZE_UNKNOWN || *unpacked_len == ZSTD_CONTENTSIZE_ERROR)
-			*unpacked_len = 0;
+int unarchive_data::load_dictionary(ZSTD_DCtx * ctx, const archive_metadata * meta, const char * frame, std::size_t frame_len, std::string & dictionary,
+                                    std::string & reference) {
+	if(meta && !meta->patch_from.empty()) {
+		reference = load_reference(*meta, derive_contained_name(), cfg);
+		if(reference.empty())
+			return E_EOPEN;
+		ZSTD_DCtx_refPrefix(ctx, reference.data(), reference.size());
 	}
-	return *unpacked_len;
+	if(reference.empty())
+		if(const auto dict_id = ZSTD_getDictID_fromFrame(frame, frame_len)) {
+			dictionary = cfg.dictionary_for(dict_id);
+			if(dictionary.empty())
+				return E_BAD_DATA;
+			ZSTD_DCtx_loadDictionary_byReference(ctx, dictionary.data(), dictionary.size());
+		}
+	return 0;
 }
 
 int unarchive_data::unpack(std::ostream & into) {
+	return decode(into, data_process_callback);
+}
+
+int unarchive_data::decode(std::ostream & into, tProcessDataProc progress, checkpoint * reached, std::istream * prefix) {
 	if(fstream == INVALID_HANDLE_VALUE)
 		return E_EREAD;
 
-	if(iobuf_consumed) {
-		iobuf_overlapped.OffsetHigh = iobuf_overlapped.Offset = 0;
-		if(!ReadFile(fstream, iobuf, sizeof(iobuf), nullptr, &iobuf_overlapped))
-			if(GetLastError() != ERROR_IO_PENDING)
-				return E_EREAD;
-	}
-	if(!unpacked_len || iobuf_consumed)
-		await_iobuf();
-	iobuf_consumed = true;
+	// Decoding takes up a core, which packing running alongside shouldn't count on
+	const worker_share share;
+	memory_reservation memory;
+	const auto one_shot_threshold = cfg.one_shot_threshold * 1024 * 1024;
+	// Only start reading ahead once there's something to extract or test; small archives in one read, to decode in one go
+	const auto min_read  = size <= one_shot_threshold ? std::max<std::size_t>(size, 1) : cfg.readahead_buffer_min * 1024 * 1024;
+	const auto max_read  = std::max(min_read, cfg.readahead_buffer_max * 1024 * 1024);
+	const auto resume_at = reached && prefix ? reached->archive_offset : 0;
+	read_queue reads(fstream, size, resume_at, cfg.readahead_depth, min_read, max_read);
+	auto chunk = reads.next();
+	if(!chunk)
+		return E_EREAD;
 
+	const auto out_buf_size = ZSTD_DStreamOutSize() * 2;
 
-	unpacked_len = 0;
+	std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ctx{ZSTD_createDStream(), ZSTD_freeDStream};
 
-	const auto in_buf_size  = sizeof(iobuf) * 2;
-	const auto out_buf_size = ZSTD_DStreamOutSize() * 2;  // we have * 2 in iobuf
-	auto in_buffer          = std::make_unique<char[]>(in_buf_size);
-	auto out_buffer         = std::make_unique<char[]>(out_buf_size);
-	ZSTD_inBuffer in_buf{in_buffer.get(), 0, 0};
+	// Resuming starts at a frame past the metadata
+	std::string dictionary, reference;
+	std::optional<archive_metadata> meta;
+	std::size_t data_start{};
+	if(resume_at) {
+		if(const auto recorded = read_metadata())
+			meta = *recorded;
+	} else if(auto frame = archive_metadata::from_frame(chunk->first, chunk->second)) {
+		meta       = std::move(frame->first);
+		data_start = frame->second;
+	}
+	if(const auto err = load_dictionary(ctx.get(), meta ? &*meta : nullptr, chunk->first + data_start, chunk->second - data_start, dictionary, reference))
+		return err;
+	const auto verifying = meta && content_verifier::applies_to(*meta);
+
+	// The window's the bulk of it: compression-rules may ask for ones past the default limit, up to what fits in the memory budget.
+	// Frames with larger ones are refused with windowTooLarge
+	const auto available = memory.available();
+	const auto reads_mem = [&](std::size_t read_size) { return cfg.readahead_depth * static_cast<std::size_t>(std::min<std::uint64_t>(read_size, size)); };
+	const auto fixed     = reference.size() + dictionary.size() + (verifying ? verify_depth : 1) * out_buf_size;
+	auto window_log_max  = ZSTD_WINDOWLOG_MAX;
+	while(window_log_max > ZSTD_WINDOWLOG_MIN && fixed + reads_mem(min_read) + ZSTD_estimateDStreamSize(std::size_t{1} << window_log_max) > available)
+		--window_log_max;
+	ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_windowLogMax, window_log_max);
+
+	ZSTD_FrameHeader frame_header{};
+	ZSTD_getFrameHeader(&frame_header, chunk->first + data_start, chunk->second - data_start);
+	if(frame_header.windowSize > (std::uint64_t{1} << window_log_max))
+		return E_NO_MEMORY;
+
+	// Reads get what's left
+	const auto window_mem = ZSTD_estimateDStreamSize(frame_header.windowSize);
+	const auto spare      = available > fixed + window_mem ? available - fixed - window_mem : 0;
+	const auto read_limit = std::clamp(spare / std::max<std::size_t>(cfg.readahead_depth, 1), min_read, max_read);
+	reads.limit(read_limit);
+	memory.reserve(fixed + window_mem + reads_mem(read_limit));
+
+	if(chunk->second == size)
+		if(const auto content_size = ZSTD_findDecompressedSize(chunk->first, chunk->second);
+		   content_size <= one_shot_threshold && fixed + size + content_size <= available) {
+			memory.reserve(fixed + size + content_size);
+			auto out = std::make_unique<char[]>(content_size);
+			if(ZSTD_isError(ZSTD_decompressDCtx(ctx.get(), out.get(), content_size, chunk->first, chunk->second)))
+				return E_BAD_ARCHIVE;
 
-	std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ctx{ZSTD_createDStream(), ZSTD_freeDStream};
-	ZSTD_initDStream(ctx.get());
+			into.write(out.get(), content_size);
+			if(!into)
+				return E_EWRITE;
 
-	for(;;) {
-		std::memmove(const_cast<void *>(in_buf.src), static_cast<const char *>(in_buf.src) + in_buf.pos, in_buf.size - in_buf.pos);
-		in_buf.size = in_buf.size - in_buf.pos;
-		in_buf.pos  = 0;
-		std::memcpy(const_cast<char *>(static_cast<const char *>(in_buf.src)) + in_buf.size, iobuf, iobuf_len);
-		in_buf.size += iobuf_len;
+			if(progress && !progress(file.data(), chunk->second))
+				return E_EABORTED;
+			if(verifying) {
+				content_hash hash(!meta->content_sha256.empty());
+				hash.update(out.get(), content_size);
+				if(!hash.matches(*meta))
+					return E_BAD_DATA;
+			}
+			return 0;
+		}
 
-		if(!iobuf_eof)
-			if(!ReadFile(fstream, iobuf, sizeof(iobuf), nullptr, &iobuf_overlapped))
-				if(GetLastError() != ERROR_IO_PENDING)
-					return E_EREAD;
+	// Decoded straight into the verifier's buffers, hashed on its thread after being written out
+	std::optional<content_verifier> verifier;
+	std::unique_ptr<char[]> out_buffer;
+	if(verifying)
+		verifier.emplace(*meta, verify_depth, out_buf_size);
+	else
+		out_buffer = std::make_unique<char[]>(out_buf_size);
+
+	// Of the output, for the checkpoints. The output being resumed is read back and hashed as if it'd been decoded again.
+	// Counted here, not in unpacked_len, since this may be running on a reader's thread while the header's read on Total Commander's
+	std::uint64_t decoded = 0;
+	XXH64_state_t written;
+	XXH64_reset(&written, 0);
+	if(resume_at) {
+		for(auto left = reached->output_offset; left;) {
+			const auto buf = verifier ? verifier->buffer() : out_buffer.get();
+			const auto len = static_cast<std::size_t>(std::min<std::uint64_t>(left, out_buf_size));
+			if(!prefix->read(buf, len))
+				return prefix_changed;
+			XXH64_update(&written, buf, len);
+			if(verifier)
+				verifier->consume(len);
+			left -= len;
+		}
+		if(XXH64_digest(&written) != reached->output_xxh64)
+			return prefix_changed;
 
-		while(in_buf.size != in_buf.pos) {
-			ZSTD_outBuffer out_buf{out_buffer.get(), out_buf_size, 0};
+		into.seekp(reached->output_offset);
+		decoded = reached->output_offset;
+		if(progress && !progress(file.data(), resume_at))
+			return E_EABORTED;
+	}
+
+	// The decoder takes all of its input unless the output fills up, so it's fed straight from the read buffers
+	std::size_t res = 0;
+	for(auto chunk_offset = resume_at; chunk->second;) {
+		ZSTD_inBuffer in_buf{chunk->first, chunk->second, 0};
+		for(bool more = true; more;) {
+			ZSTD_outBuffer out_buf{verifier ? verifier->buffer() : out_buffer.get(), out_buf_size, 0};
 
 			const auto pre = in_buf.pos;
-			const auto res = ZSTD_decompressStream(ctx.get(), &out_buf, &in_buf);
+			res            = ZSTD_decompressStream(ctx.get(), &out_buf, &in_buf);
 			if(ZSTD_isError(res))
-				return E_BAD_ARCHIVE;
+				return ZSTD_getErrorCode(res) == ZSTD_error_frameParameter_windowTooLarge ? E_NO_MEMORY : E_BAD_ARCHIVE;
+			if(res == 0 && !reference.empty())  // end of frame
+				ZSTD_DCtx_refPrefix(ctx.get(), reference.data(), reference.size());
 
 			into.write(static_cast<char *>(out_buf.dst), out_buf.pos);
 			if(!into)
 				return E_EWRITE;
-			*unpacked_len += out_buf.pos;
+			decoded += out_buf.pos;
+			if(reached) {
+				XXH64_update(&written, out_buf.dst, out_buf.pos);
+				if(res == 0) {
+					*reached = {chunk_offset + in_buf.pos, decoded, XXH64_digest(&written)};
+					passed_checkpoint(*reached, &into);
+				}
+			}
+			if(verifier)
+				verifier->consume(out_buf.pos);
 
-			if(data_process_callback && !data_process_callback(file.data(), in_buf.pos - pre))
+			if(progress && !progress(file.data(), in_buf.pos - pre))
 				return E_EABORTED;
 
-			if(out_buf.pos < out_buf.size)
-				break;
+			// Frame ends stop the decoder early, and a full output buffer may have more behind it, unless the frame's done
+			more = in_buf.pos != in_buf.size || (out_buf.pos == out_buf.size && res != 0);
+		}
+
+		chunk_offset += chunk->second;
+		if(!(chunk = reads.next()))
+			return E_EREAD;
+	}
+	if(res != 0)  // Cut off mid-frame
+		return E_BAD_ARCHIVE;
+
+	return verifier ? verifier->verify() : 0;
+}
+
+std::optional<std::size_t> unarchive_data::mapped_size() {
+	if(fstream == INVALID_HANDLE_VALUE)
+		return std::nullopt;
+
+	char header[ZSTD_FRAMEHEADERSIZE_MAX];
+	ZSTD_FrameHeader frame_header{};
+	if(ZSTD_getFrameHeader(&frame_header, header, read_at(data_start, header, sizeof(header))) != 0 || frame_header.windowSize < mapped_window_min)
+		return std::nullopt;
+
+	std::optional<std::uint64_t> content_size;
+	if(const auto meta = read_metadata(); meta && meta->content_size)
+		content_size = meta->content_size;
+	else if(size <= SIZE_MAX) {
+		// Walked through frame by frame, in a mapping of the archive, so only the frame headers are read
+		std::unique_ptr<void, decltype(&CloseHandle)> mapping{size ? CreateFileMapping(fstream, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr, CloseHandle};
+		std::unique_ptr<const void, decltype(&UnmapViewOfFile)> view{mapping ? MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0) : nullptr, UnmapViewOfFile};
+		if(view)
+			if(const auto total = ZSTD_findDecompressedSize(view.get(), size); total != ZSTD_CONTENTSIZE_UNKNOWN && total != ZSTD_CONTENTSIZE_ERROR)
+				content_size = total;
+	}
+	if(!content_size || !*content_size || *content_size > mapped_size_max)
+		return std::nullopt;
+	return static_cast<std::size_t>(*content_size);
+}
+
+int unarchive_data::decode_mapped(const char * path, std::size_t content_size, checkpoint & reached, bool resuming) {
+	if(fstream == INVALID_HANDLE_VALUE)
+		return E_EREAD;
+
+	const worker_share share;
+	memory_reservation memory;
+
+	// Sized up front, so the whole of it can be mapped; what was extracted before is kept, to resume from
+	const auto out_file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, resuming ? OPEN_EXISTING : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if(out_file == INVALID_HANDLE_VALUE)
+		return resuming ? prefix_changed : E_ECREATE;
+	std::unique_ptr<void, decltype(&CloseHandle)> out_file_closer{out_file, CloseHandle};
+	LARGE_INTEGER end;
+	end.QuadPart = content_size;
+	if(!SetFilePointerEx(out_file, end, nullptr, FILE_BEGIN) || !SetEndOfFile(out_file))
+		return E_EWRITE;
+	std::unique_ptr<void, decltype(&CloseHandle)> mapping{CreateFileMapping(out_file, nullptr, PAGE_READWRITE, 0, 0, nullptr), CloseHandle};
+	std::unique_ptr<void, decltype(&UnmapViewOfFile)> view{mapping ? MapViewOfFile(mapping.get(), FILE_MAP_WRITE, 0, 0, content_size) : nullptr, UnmapViewOfFile};
+	if(!view)
+		return unmappable;
+	const auto out = static_cast<char *>(view.get());
+
+	const auto meta = read_metadata();
+	std::optional<content_hash> hash;
+	if(meta && content_verifier::applies_to(*meta))
+		hash.emplace(!meta->content_sha256.empty());
+
+	// Checked in place: everything up to the checkpoint's already in the mapping
+	XXH64_state_t written;
+	XXH64_reset(&written, 0);
+	if(resuming) {
+		if(reached.output_offset > content_size || XXH64(out, reached.output_offset, 0) != reached.output_xxh64)
+			return prefix_changed;
+		XXH64_update(&written, out, reached.output_offset);
+		if(hash)
+			hash->update(out, reached.output_offset);
+	}
+
+	const auto one_shot_threshold = cfg.one_shot_threshold * 1024 * 1024;
+	const auto min_read           = size <= one_shot_threshold ? std::max<std::size_t>(size, 1) : cfg.readahead_buffer_min * 1024 * 1024;
+	const auto max_read           = std::max(min_read, cfg.readahead_buffer_max * 1024 * 1024);
+	const auto resume_at          = resuming ? reached.archive_offset : 0;
+	read_queue reads(fstream, size, resume_at, cfg.readahead_depth, min_read, max_read);
+	auto chunk = reads.next();
+	if(!chunk)
+		return E_EREAD;
+
+	// The output is the window, however large, so the decoder only needs its input buffer
+	std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ctx{ZSTD_createDStream(), ZSTD_freeDStream};
+	ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_stableOutBuffer, 1);
+	ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX);
+	std::string dictionary, reference;
+	const auto frame_start = resuming ? 0 : std::min<std::size_t>(data_start, chunk->second);
+	if(const auto err = load_dictionary(ctx.get(), meta, chunk->first + frame_start, chunk->second - frame_start, dictionary, reference))
+		return err;
+
+	const auto available = memory.available();
+	const auto fixed     = reference.size() + dictionary.size() + ZSTD_estimateDCtxSize() + ZSTD_BLOCKSIZE_MAX;
+	const auto spare     = available > fixed ? available - fixed : 0;
+	const auto read_size = std::clamp(spare / std::max<std::size_t>(cfg.readahead_depth, 1), min_read, max_read);
+	reads.limit(read_size);
+	memory.reserve(fixed + cfg.readahead_depth * static_cast<std::size_t>(std::min<std::uint64_t>(read_size, size)));
+
+	unpacked_len = content_size;
+	ZSTD_outBuffer out_buf{out, content_size, resuming ? static_cast<std::size_t>(reached.output_offset) : 0};
+	if(resuming && data_process_callback && !data_process_callback(file.data(), resume_at))
+		return E_EABORTED;
+
+	std::size_t res = 0;
+	for(auto chunk_offset = resume_at; chunk->second;) {
+		for(ZSTD_inBuffer in_buf{chunk->first, chunk->second, 0}; in_buf.pos != in_buf.size;) {
+			const auto pre_in  = in_buf.pos;
+			const auto pre_out = out_buf.pos;
+			res                = ZSTD_decompressStream(ctx.get(), &out_buf, &in_buf);
+			if(ZSTD_isError(res))  // More than the size it said
+				return ZSTD_getErrorCode(res) == ZSTD_error_dstSize_tooSmall ? unmappable : E_BAD_ARCHIVE;
+			if(res == 0 && !reference.empty())  // end of frame
+				ZSTD_DCtx_refPrefix(ctx.get(), reference.data(), reference.size());
+
+			XXH64_update(&written, out + pre_out, out_buf.pos - pre_out);
+			if(hash)
+				hash->update(out + pre_out, out_buf.pos - pre_out);
+			if(res == 0) {
+				reached = {chunk_offset + in_buf.pos, out_buf.pos, XXH64_digest(&written)};
+				passed_checkpoint(reached, nullptr);
+			}
+
+			if(data_process_callback && !data_process_callback(file.data(), in_buf.pos - pre_in))
+				return E_EABORTED;
 		}
 
-		if(iobuf_eof)
+		chunk_offset += chunk->second;
+		if(!(chunk = reads.next()))
+			return E_EREAD;
+	}
+	if(res != 0)  // Cut off mid-frame
+		return E_BAD_ARCHIVE;
+	if(out_buf.pos != content_size)  // Or less
+		return unmappable;
+
+	return hash && !hash->matches(*meta) ? E_BAD_DATA : 0;
+}
+
+int unarchive_data::read_content(void * buf, std::size_t len, std::size_t & read) {
+	if(!content) {
+		read_metadata();  // Here, so the reader's thread only ever finds it read
+		content = std::make_unique<content_reader>([this](std::ostream & out) { return decode(out, nullptr); }, content_chunk_depth, content_chunk_size);
+	}
+
+	for(read = 0; read != len;) {
+		const auto piece = content->next(len - read);
+		if(!piece)
+			return content->error();
+		if(!piece->second)
 			break;
-		await_iobuf();
+		std::memcpy(static_cast<char *>(buf) + read, piece->first, piece->second);
+		read += piece->second;
 	}
-	for(;;) {
-		ZSTD_outBuffer out_buf{out_buffer.get(), out_buf_size, 0};
+	return 0;
+}
 
-		const auto pre = in_buf.pos;
-		const auto res = ZSTD_decompressStream(ctx.get(), &out_buf, &in_buf);
-		if(ZSTD_isError(res))
+int unarchive_data::search(const pattern_matcher & matcher, const match_callback & found) {
+	if(fstream == INVALID_HANDLE_VALUE)
+		return E_EREAD;
+
+	const auto sequential = [&] {
+		searching_streambuf buf(matcher, found);
+		std::ostream out(&buf);
+		const auto err = decode(out, nullptr);
+		return buf.stopped ? E_EABORTED : err;
+	};
+
+	std::unique_ptr<void, decltype(&CloseHandle)> mapping{size ? CreateFileMapping(fstream, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr, CloseHandle};
+	std::unique_ptr<const void, decltype(&UnmapViewOfFile)> view{mapping ? MapViewOfFile(mapping.get(), FILE_MAP_READ, 0, 0, 0) : nullptr, UnmapViewOfFile};
+	if(!view || size > SIZE_MAX)
+		return sequential();
+	const auto data = static_cast<const char *>(view.get());
+
+	// Every frame but the first needs whatever it was compressed against set up again, so those are left to decode()
+	std::vector<std::pair<std::size_t, std::size_t>> frames;
+	std::uint64_t window_size = 0;
+	for(std::size_t pos = 0; pos != size;) {
+		const auto len = ZSTD_findFrameCompressedSize(data + pos, size - pos);
+		if(ZSTD_isError(len))
 			return E_BAD_ARCHIVE;
 
-		into.write(static_cast<char *>(out_buf.dst), out_buf.pos);
-		if(!into)
-			return E_EWRITE;
-		*unpacked_len += out_buf.pos;
+		if(ZSTD_isSkippableFrame(data + pos, len)) {
+			if(const auto meta = archive_metadata::from_frame(data + pos, len); meta && !meta->first.patch_from.empty())
+				return sequential();
+		} else {
+			ZSTD_FrameHeader header{};
+			if(ZSTD_getFrameHeader(&header, data + pos, len) != 0)
+				return E_BAD_ARCHIVE;
+			if(header.dictID)
+				return sequential();
+			window_size = std::max<std::uint64_t>(window_size, header.windowSize);
+			frames.emplace_back(pos, len);
+		}
+		pos += len;
+	}
 
-		if(data_process_callback && !data_process_callback(file.data(), in_buf.pos - pre))
-			return E_EABORTED;
+	const worker_share share;
+	memory_reservation memory;
+	const auto out_buf_size = ZSTD_DStreamOutSize();
+	const auto per_worker   = ZSTD_estimateDStreamSize(window_size) + out_buf_size;
+	const auto available    = memory.available();
+	if(per_worker > available)
+		return E_NO_MEMORY;
+	const auto workers = std::max<std::size_t>(std::min({share.workers(), frames.size(), available / per_worker}), 1);
+	memory.reserve(workers * per_worker);
+
+	std::vector<frame_search> results(frames.size());
+	std::mutex lock;
+	std::condition_variable changed;
+	std::atomic<std::size_t> next{0};
+	std::atomic<bool> stopping{false};
+	// Frames are only searched this far past the one being reported, so the matches held for them stay bounded
+	const auto frames_ahead = 2 * workers;
+	std::size_t reporting   = 0;
+	const auto overlap = matcher.overlap();
+	const auto work    = [&] {
+		std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ctx{ZSTD_createDStream(), ZSTD_freeDStream};
+		ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX);  // Already checked against the budget
+		auto out_buffer = std::make_unique<char[]>(out_buf_size);
+
+		for(std::size_t i; !stopping && (i = next++) < frames.size();) {
+			{
+				std::unique_lock<std::mutex> guard(lock);
+				changed.wait(guard, [&] { return stopping || i < reporting + frames_ahead; });
+			}
+
+			frame_search result;
+			pattern_stream stream(matcher);
+			const auto keep = [&](std::size_t pattern, std::uint64_t at) {
+				result.matches.emplace_back(pattern, at);
+				return !stopping;
+			};
+
+			ZSTD_DCtx_reset(ctx.get(), ZSTD_reset_session_only);
+			ZSTD_inBuffer in_buf{data + frames[i].first, frames[i].second, 0};
+			for(std::size_t res = 1; res != 0 && !stopping;) {
+				ZSTD_outBuffer out_buf{out_buffer.get(), out_buf_size, 0};
+				res = ZSTD_decompressStream(ctx.get(), &out_buf, &in_buf);
+				if(ZSTD_isError(res)) {
+					result.err = E_BAD_ARCHIVE;
+					break;
+				}
+
+				result.head.append(out_buffer.get(), std::min(out_buf.pos, overlap - result.head.size()));
+				stream.feed(out_buffer.get(), out_buf.pos, keep);
+				result.size += out_buf.pos;
+				if(res != 0 && in_buf.pos == in_buf.size && out_buf.pos != out_buf.size) {  // Cut off mid-frame
+					result.err = E_BAD_ARCHIVE;
+					break;
+				}
+			}
+			result.tail = stream.tail();
+			result.done = true;
+
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				results[i] = std::move(result);
+			}
+			changed.notify_all();
+		}
+	};
+	std::vector<std::thread> threads(workers);
+	for(auto && t : threads)
+		t = std::thread(work);
+
+	// Reported in order as the frames are done, with the matches spanning them found from their heads and tails
+	int err = 0;
+	pattern_stream seams(matcher);
+	std::uint64_t base = 0;
+	const auto report  = [&](std::size_t pattern, std::uint64_t at) { return found(pattern, at) || (err = E_EABORTED, false); };
+	for(auto && result : results) {
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			changed.wait(guard, [&] { return result.done; });
+			reporting = &result - results.data();
+		}
+		changed.notify_all();
+		if((err = result.err) || !seams.seam(result.head.data(), result.head.size(), report))
+			break;
+		for(auto && [pattern, at] : result.matches)
+			if(!report(pattern, base + at))
+				break;
+		if(err)
+			break;
+
+		seams.skip(result.size, result.tail);
+		base += result.size;
+		std::vector<std::pair<std::size_t, std::uint64_t>>{}.swap(result.matches);
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	for(auto && t : threads)
+		t.join();
+	return err;
+}
+
+std::optional<unarchive_data::checkpoint> unarchive_data::read_checkpoint(const std::string & path) {
+	std::ifstream in(path);
+	const auto saved = nlohmann::json::parse(in, nullptr, false);
+	if(!saved.is_object())
+		return std::nullopt;
+
+	try {
+		if(saved.value("archive‐size", std::uint64_t{}) != size || saved.value("archive‐mtime", std::int64_t{}) != unix_time(mtime))
+			return std::nullopt;
+		return checkpoint{saved.at("frame").get<std::uint64_t>(), saved.at("output").get<std::uint64_t>(), saved.at("output‐xxh64").get<std::uint64_t>()};
+	} catch(...) {
+		return std::nullopt;
+	}
+}
+
+void unarchive_data::write_checkpoint(const std::string & path, const checkpoint & at) {
+	// Replaced whole, so being killed while writing it leaves the previous one
+	const auto temp = path + ".new";
+	std::ofstream out(temp);
+	out << nlohmann::ordered_json{
+	    {"totalcmd‐zstd", TOTALCMD_ZSTD_VERSION},
+	    {"archive‐size", size},
+	    {"archive‐mtime", unix_time(mtime)},
+	    {"frame", at.archive_offset},
+	    {"output", at.output_offset},
+	    {"output‐xxh64", at.output_xxh64},
+	};
+	out.close();
+
+	std::error_code ec;
+	if(out)
+		std::filesystem::rename(temp, path, ec);
+	if(!out || ec)
+		std::filesystem::remove(temp, ec);
+}
+
+void unarchive_data::passed_checkpoint(const checkpoint & at, std::ostream * out) {
+	if(checkpoint_path.empty() || std::chrono::steady_clock::now() - last_checkpoint < checkpoint_interval)
+		return;
+	// The output up to it is checked against it before resuming, so it has to be in the file
+	if(out && !out->flush())
+		return;
+	write_checkpoint(checkpoint_path, at);
+	last_checkpoint = std::chrono::steady_clock::now();
+}
+
+int unarchive_data::unpack_to(const char * path) {
+	checkpoint_path  = path + std::string{checkpoint_suffix};
+	last_checkpoint  = std::chrono::steady_clock::now();
+	auto resume_from = read_checkpoint(checkpoint_path);
+
+	// Zeros are skipped over instead, if the file can be made sparse
+	const auto sparse    = cfg.sparse_extraction;
+	const auto decode_to = [&](std::fstream & out, checkpoint & reached, std::istream * prefix) {
+		if(!sparse || !mark_sparse(path))
+			return decode(out, data_process_callback, &reached, prefix);
+		sparse_ostream holes(out);
+		const auto err = decode(holes, data_process_callback, &reached, prefix);
+		return !holes.finish() && !err ? E_EWRITE : err;
+	};
+
+	// Large windows are decoded into the file itself instead; not sparse ones, which writing all of it through the mapping would fill in
+	auto reached = resume_from.value_or(checkpoint{});
+	auto err     = unmappable;
+	if(const auto content_size = sparse ? std::nullopt : mapped_size()) {
+		err = resume_from ? decode_mapped(path, *content_size, reached, true) : prefix_changed;
+		if(err == prefix_changed) {
+			reached = {};
+			err     = decode_mapped(path, *content_size, reached, false);
+		}
+		if(err == unmappable) {
+			reached = {};
+			resume_from.reset();
+		}
+	}
+
+	if(err == unmappable) {
+		std::fstream out;
+		if(resume_from)
+			out.open(path, std::ios::in | std::ios::out | std::ios::binary);
+		err = out.is_open() ? decode_to(out, reached, &out) : prefix_changed;
+		if(err == prefix_changed) {
+			// Not there any more, or not what was extracted before: from the start after all
+			out.close();
+			out.open(path, std::ios::out | std::ios::trunc | std::ios::binary);
+			if(!out)
+				return E_ECREATE;
+			reached = {};
+			err     = decode_to(out, reached, nullptr);
+		}
+		out.close();
+		if(!err && !out)
+			err = E_EWRITE;
+	}
+
+	std::error_code ec;
+	if(err && reached.output_offset)
+		write_checkpoint(checkpoint_path, reached);
+	else
+		std::filesystem::remove(checkpoint_path, ec);
+	checkpoint_path.clear();
+	return err;
+}
+
+bool unarchive_data::lists_members() {
+	if(!listing_members) {
+		listing_members = false;
+
+		if(fstream != INVALID_HANDLE_VALUE && cfg.tar_members && is_tarball_name(derive_contained_name())) {
+			// Decoded on a thread of its own, without reporting progress from there; the members' is reported instead
+			tar = std::make_unique<tar_reader>([this](std::ostream & out) { return decode(out, nullptr); });
+
+			// Not a tarball after all, or an empty one: shown as is
+			tar_reader::member first;
+			if(tar->next(first)) {
+				tar.reset();
+				return false;
+			}
+
+			member          = std::move(first);
+			member_pending  = true;
+			listing_members = true;
+			record_member();
+			if(cfg.parallel_extraction)
+				writers = std::make_unique<writer_pool>();
+		}
+	}
+	return *listing_members;
+}
+
+int unarchive_data::next_member() {
+	if(std::exchange(member_pending, false))
+		return 0;
+
+	tar_reader::member next;
+	if(const auto err = tar->next(next)) {
+		// Everything's only been extracted once it's all been written out
+		if(err == E_END_ARCHIVE && writers)
+			if(const auto write_err = writers->wait())
+				return write_err;
+		return err;
+	}
+	member = std::move(next);
+	++member_index;
+	record_member();
+	return 0;
+}
+
+void unarchive_data::record_member() {
+	if(!member->link.empty()) {
+		if(const auto target = files_read.find(member->link); target != files_read.end())
+			member->size = target->second.size;
+	} else if(!member->directory)
+		files_read[member->name] = {member->size, member_index, {}};
+}
+
+const tar_reader::member & unarchive_data::current_member() const {
+	return *member;
+}
+
+int unarchive_data::unpack_member(const char * path) {
+	std::error_code ec;
+	if(member->directory) {
+		if(path)
+			std::filesystem::create_directories(path, ec);
+		return 0;
+	}
+
+	const auto mtime = unix_to_filetime(member->mtime);
+	if(!member->link.empty()) {
+		if(!path)
+			return 0;
 
-		if(in_buf.pos == in_buf.size && out_buf.pos == 0)
+		const auto target = files_read.find(member->link);
+		if(target == files_read.end())
+			return E_NOT_SUPPORTED;
+		if(writers)  // It may still be queued; what that fails with is reported at the end
+			writers->wait();
+
+		if(!target->second.path.empty()) {
+			std::filesystem::copy_file(target->second.path, path, std::filesystem::copy_options::overwrite_existing, ec);
+			if(!ec) {
+				set_file_mtime(path, mtime);
+				return 0;
+			}
+		}
+		// Skipped, or gone since
+		return extract_member_again(target->second.index, path, mtime);
+	}
+	if(path)
+		files_read[member->name].path = path;
+
+	// Small files are written out in the background, so many of them aren't bound by one thread's syscalls
+	if(path && writers && member->size <= writers->max_file_size()) {
+		std::string data;
+		data.reserve(member->size);
+		for(;;) {
+			const auto piece = tar->content();
+			if(!piece)
+				return tar->error();
+			if(!piece->second)
+				break;
+			data.append(piece->first, piece->second);
+			if(data_process_callback && !data_process_callback(const_cast<char *>(path), piece->second))
+				return E_EABORTED;
+		}
+
+		writers->write(path, std::move(data), mtime);
+		return 0;
+	}
+	// An earlier member with the same name may still be queued, and has to land first
+	if(path && writers)
+		writers->wait_for(path);
+
+	return write_member(*tar, path, mtime);
+}
+
+int unarchive_data::write_member(tar_reader & from, const char * path, const FILETIME & mtime) {
+	const auto progress_name = path ? const_cast<char *>(path) : file.data();
+
+	std::ofstream out;
+	std::optional<sparse_ostream> holes;
+	if(path) {
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+		out.open(path, std::ios::binary);
+		if(!out)
+			return E_ECREATE;
+		if(cfg.sparse_extraction && mark_sparse(path))
+			holes.emplace(out);
+	}
+	auto & to = holes ? static_cast<std::ostream &>(*holes) : out;
+	for(;;) {
+		const auto piece = from.content();
+		if(!piece)
+			return from.error();
+		if(!piece->second)
 			break;
+		if(path && !to.write(piece->first, piece->second))
+			return E_EWRITE;
+		if(data_process_callback && !data_process_callback(progress_name, piece->second))
+			return E_EABORTED;
 	}
 
+	if(path) {
+		if(holes && !holes->finish())
+			return E_EWRITE;
+		out.close();
+		if(!out)
+			return E_EWRITE;
+		set_file_mtime(path, mtime);
+	}
 	return 0;
 }
+
+int unarchive_data::extract_member_again(std::size_t index, const char * path, const FILETIME & mtime) {
+	tar_reader again([this](std::ostream & out) { return decode(out, nullptr); });
+	tar_reader::member target;
+	for(std::size_t i = 0; i <= index; ++i)
+		if(const auto err = again.next(target))
+			return err == E_END_ARCHIVE ? E_BAD_ARCHIVE : err;
+	return write_member(again, path, mtime);
+}
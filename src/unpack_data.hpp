@@ -29,9 +29,21 @@
 #endif
 #include <windows.h>
 
+#include "config.hpp"
+#include "content_reader.hpp"
+#include "metadata.hpp"
+#include "search.hpp"
+#include "tar_reader.hpp"
+#include "writer_pool.hpp"
+#include <chrono>
 #include <cstdint>
+#include <istream>
+#include <memory>
 #include <optional>
+#include <ostream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <wcxhead.h>
 #include <zstd/zstd.h>
@@ -39,6 +51,17 @@
 
 class unarchive_data {
 public:
+	/// A frame boundary extraction can pick up again from, and a hash of the output up to it.
+	struct checkpoint {
+		std::uint64_t archive_offset, output_offset, output_xxh64;
+	};
+
+	/// Left next to a file that failed to extract, with the checkpoint to resume from, by unpack_to().
+	static const constexpr char * checkpoint_suffix = ".zstd-resume";
+	/// While extracting, it's rewritten at the first frame boundary this long after the last, so one's there even if the extraction's killed.
+	static const constexpr std::chrono::seconds checkpoint_interval{1};
+
+
 	bool file_shown;
 	tProcessDataProc data_process_callback;
 
@@ -46,25 +69,142 @@ public:
 	std::uint64_t size;
 
 private:
+	/// Read when opened, for everything done with the archive, on whichever thread.
+	const configuration cfg;
 	std::string file;
 	HANDLE fstream;
-	char iobuf[(ZSTD_BLOCKSIZE_MAX + 10) * 2];  // ZSTD_DStreamInSize() is ZSTD_BLOCKSIZE_MAX + ZSTD_blockHeaderSize (private 3)
-	OVERLAPPED iobuf_overlapped;
-	std::size_t iobuf_len;
-	bool iobuf_consumed, iobuf_eof;
 	std::optional<std::uint64_t> unpacked_len;
-
-	void await_iobuf();
+	bool metadata_read;
+	std::optional<archive_metadata> metadata;
+	/// Where the first frame after the leading skippable one, if any, starts.
+	std::uint64_t data_start;
+	/// Started by read_content().
+	std::unique_ptr<content_reader> content;
+	/// Set by lists_members() if the tarball's members are listed instead of it, decoded as they're read.
+	std::optional<bool> listing_members;
+	std::unique_ptr<tar_reader> tar;
+	std::optional<tar_reader::member> member;
+	/// Whether lists_members() read the first member ahead.
+	bool member_pending;
+	/// Of the current member, counting from 0.
+	std::size_t member_index;
+	/// Set with "parallel‐extraction".
+	std::unique_ptr<writer_pool> writers;
+	struct member_file {
+		std::uint64_t size;
+		std::size_t index;
+		/// Where it's been extracted to, if it has.
+		std::string path;
+	};
+	/// The last file member read so far with each name, for the hard links to them.
+	std::unordered_map<std::string, member_file> files_read;
+
+	/// Synchronously read at the specified offset.
+	///
+	/// Return value: bytes read, 0 on error.
+	std::size_t read_at(std::uint64_t offset, void * into, std::size_t len);
+
+	/// Return value: the metadata frame, read with one small read on first use, or nullptr if the archive has none.
+	const archive_metadata * read_metadata();
+
+	/// Returned by decode() if the output to resume from doesn't match the checkpoint. Never passed on to Total Commander.
+	static const constexpr int prefix_changed = -1;
+
+	/// Decode the whole archive into the specified stream, reporting progress through the specified callback, if any.
+	///
+	/// If reached is set, it's kept at the last frame boundary passed. If prefix is set too, it holds the output up to reached already,
+	/// which is checked, then decoding picks up from there; into needs to be positioned past it.
+	int decode(std::ostream & into, tProcessDataProc progress, checkpoint * reached = nullptr, std::istream * prefix = nullptr);
+
+	/// Set the decoder up with the reference file or the dictionary the frame starting with the specified bytes was packed against, if any,
+	/// kept in the specified strings.
+	///
+	/// Return value: 0, E_EOPEN if the reference file's gone, or E_BAD_DATA if the dictionary isn't configured.
+	int load_dictionary(ZSTD_DCtx * ctx, const archive_metadata * meta, const char * frame, std::size_t frame_len, std::string & dictionary,
+	                    std::string & reference);
+
+	/// Returned by decode_mapped() if the output couldn't be mapped, or the content isn't the size recorded. Never passed on to Total Commander.
+	static const constexpr int unmappable = -2;
+
+	/// The whole content's size is known if it's recorded in the metadata, or every frame records its own; the first frame's alone isn't enough.
+	///
+	/// Return value: the size to map the output at if unpack_to() extracts with decode_mapped(): the content size is known and fits in the address space,
+	/// and the window's large.
+	std::optional<std::size_t> mapped_size();
+
+	/// Extract to the specified file like decode(), but straight into a mapping of it, sized up front at content_size, which the decoder then uses
+	/// as its window (ZSTD_d_stableOutBuffer), instead of allocating one as large. Hashes are checked on this thread.
+	///
+	/// If resuming, the file holds the output up to reached already, which is checked, then decoding picks up from there.
+	int decode_mapped(const char * path, std::size_t content_size, checkpoint & reached, bool resuming);
+
+	/// Return value: the checkpoint recorded at the specified path, if it's of this archive.
+	std::optional<checkpoint> read_checkpoint(const std::string & path);
+	void write_checkpoint(const std::string & path, const checkpoint & at);
+	/// Set by unpack_to() while extracting: where to keep the checkpoint, and when it was last written.
+	std::string checkpoint_path;
+	std::chrono::steady_clock::time_point last_checkpoint;
+	/// Called at each frame boundary reached: write it to checkpoint_path, if set and checkpoint_interval has passed, after flushing the output, if a stream.
+	void passed_checkpoint(const checkpoint & at, std::ostream * out);
+
+	/// Note the member just read in files_read, or give a hard link the size of what it links to.
+	void record_member();
+
+	/// Write the rest of the current member of the specified reader to the specified path, or just read it if nullptr, reporting progress.
+	int write_member(tar_reader & from, const char * path, const FILETIME & mtime);
+
+	/// Extract the file member with the specified index again, reading the tarball from the start on a reader of its own,
+	/// for a hard link to it when it was skipped.
+	int extract_member_again(std::size_t index, const char * path, const FILETIME & mtime);
 
 
 public:
-	unarchive_data(const char * fname);
+	/// Nothing is read until it's needed, since most archives are only opened to be listed.
+	unarchive_data(const char * fname, configuration cfg);
 	~unarchive_data();
 	unarchive_data(const unarchive_data &) = delete;
 	unarchive_data(unarchive_data &&)      = delete;
 
+	/// Read the metadata, and the start of the archive along with it, ahead of decoding, which then finds them in the system's cache.
+	void prefetch();
+
 	const char * derive_archive_name() const;
-	std::string derive_contained_name() const;
-	std::uint64_t unpacked_size();
+	/// The name recorded when packing, or the archive's without the extension.
+	std::string derive_contained_name();
+	/// Return value: the modification time recorded when packing, if any.
+	std::optional<FILETIME> original_mtime();
+	/// Return value: the size recorded when packing, or in the frame header, if either's known.
+	std::optional<std::uint64_t> unpacked_size();
 	int unpack(std::ostream & into);
+	/// Extract to the specified file, picking up from where an earlier extraction to it stopped, if the output up to there still matches.
+	///
+	/// If it fails or is cancelled, a checkpoint's left next to the file, for the next one.
+	int unpack_to(const char * path);
+
+	/// Read the content from the start on, decoding on a thread of its own only a few buffers ahead of what's been read,
+	/// so the start of a large archive can be shown without decoding, or reading, the rest.
+	///
+	/// Return value: 0 or an error, with read set to how much was read into buf, less than len only at the end.
+	int read_content(void * buf, std::size_t len, std::size_t & read);
+
+	/// Find the patterns in the content without writing it out, calling found with the offsets of the matches in it, in order.
+	///
+	/// Frames are decoded in parallel on the thread budget's share of threads, straight from a mapping of the archive; archives made with a
+	/// dictionary or reference file, or that can't be mapped, are searched as they're decoded, in one go.
+	///
+	/// Return value: 0, E_EABORTED if found stopped the search, or an error.
+	int search(const pattern_matcher & matcher, const match_callback & found);
+
+	/// Return value: whether the members of the tarball inside are listed instead of it, with "tar‐members"; decided by reading the first one.
+	bool lists_members();
+	/// Read the next member of the tarball, see current_member(). Hard links get the size of what they link to.
+	///
+	/// Return value: 0, E_END_ARCHIVE once they've all been read and written out, or an error, also that of the first member that failed to write
+	/// in the background.
+	int next_member();
+	const tar_reader::member & current_member() const;
+	/// Test, or extract to the specified path if not nullptr, the current member.
+	///
+	/// Hard links are extracted as copies of what they link to, which is read out of the tarball again if it wasn't extracted.
+	int unpack_member(const char * path);
 };
@@ -21,11 +21,14 @@
 
 
 #include "util.hpp"
+#include <algorithm>
+#include <cctype>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <ini.h>
+#include <iterator>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <whereami++.hpp>
@@ -76,6 +79,18 @@ static std::string maybe_expand(std::string whom) {
 	return out;
 }
 
+static std::string recode(const std::string & from, UINT from_cp, UINT to_cp) {
+	if(from.empty())
+		return {};
+
+	std::wstring wide(MultiByteToWideChar(from_cp, 0, from.data(), from.size(), nullptr, 0), L'\0');
+	MultiByteToWideChar(from_cp, 0, from.data(), from.size(), wide.data(), wide.size());
+
+	std::string out(WideCharToMultiByte(to_cp, 0, wide.data(), wide.size(), nullptr, 0, nullptr, nullptr), '\0');
+	WideCharToMultiByte(to_cp, 0, wide.data(), wide.size(), out.data(), out.size(), nullptr, nullptr);
+	return out;
+}
+
 
 int totalcmd_time(const FILETIME & from) {
 	SYSTEMTIME tm;
@@ -83,10 +98,107 @@ int totalcmd_time(const FILETIME & from) {
 	return (tm.wYear - 1980) << 25 | (tm.wMonth + 1) << 21 | (tm.wDay - 1) << 16 | tm.wHour << 11 | tm.wMinute << 5 | (tm.wSecond / 2);
 }
 
+file_format detect_format(const void * data, std::size_t len) {
+	static const unsigned char gzip_magic[] = {0x1F, 0x8B};
+	static const unsigned char xz_magic[]   = {0xFD, '7', 'z', 'X', 'Z', 0x00};
+	static const unsigned char lz4_magic[]  = {0x04, 0x22, 0x4D, 0x18};
+
+	const auto starts_with = [&](auto & magic) { return len >= sizeof(magic) && !std::memcmp(data, magic, sizeof(magic)); };
+	if(ZSTD_isFrame(data, len))
+		return file_format::zstd;
+	else if(starts_with(gzip_magic))
+		return file_format::gzip;
+	else if(starts_with(xz_magic))
+		return file_format::xz;
+	else if(starts_with(lz4_magic))
+		return file_format::lz4;
+	else
+		return file_format::unknown;
+}
+
+file_format detect_format(const char * fname) {
+	// Straight to the OS: a stream would read a whole buffer's worth for these 6 bytes
+	const auto file = CreateFileA(fname, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return file_format::unknown;
+
+	char buf[6];
+	DWORD read;
+	const auto ok = ReadFile(file, buf, sizeof(buf), &read, nullptr);
+	CloseHandle(file);
+	return ok ? detect_format(buf, read) : file_format::unknown;
+}
+
 bool verify_magic(const char * fname) {
-	char buf[4];
-	std::ifstream(fname, std::ios::binary).read(buf, sizeof(buf));
-	return ZSTD_isFrame(buf, sizeof(buf));
+	return detect_format(fname) == file_format::zstd;
+}
+
+std::string guess_contained_name(const std::string & file) {
+	std::string lowercase_file;
+	lowercase_file.reserve(file.size());
+	std::transform(file.begin(), file.end(), std::back_inserter(lowercase_file), [](char c) { return std::tolower(c); });
+
+	auto start              = file.find_last_of("\\/") + 1;
+	auto end                = file.rfind('.');
+	auto is_zstd_extension  = lowercase_file.find("zst", end) != std::string::npos;
+	auto is_tzstd_extension = lowercase_file.find("tzst", end) != std::string::npos;
+
+	if(is_tzstd_extension)
+		return file.substr(start, end + 1 - start) + "tar";
+	else if(is_zstd_extension)
+		return file.substr(start, end - start);
+	else
+		return file.substr(start);
+}
+
+bool is_tarball_name(const std::string & archive) {
+	return lowercase(guess_contained_name(archive)).ends_with(".tar");
+}
+
+std::string lowercase(std::string_view name) {
+	std::string ret(name);
+	std::transform(ret.begin(), ret.end(), ret.begin(), [](unsigned char c) { return std::tolower(c); });
+	return ret;
+}
+
+std::optional<FILETIME> file_mtime(const char * fname) {
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if(!GetFileAttributesExA(fname, GetFileExInfoStandard, &attributes))
+		return std::nullopt;
+	return attributes.ftLastWriteTime;
+}
+
+bool set_file_mtime(const char * fname, const FILETIME & mtime) {
+	const auto file = CreateFileA(fname, FILE_WRITE_ATTRIBUTES, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, 0, nullptr);
+	if(file == INVALID_HANDLE_VALUE)
+		return false;
+
+	const auto ok = SetFileTime(file, nullptr, nullptr, &mtime);
+	CloseHandle(file);
+	return ok;
+}
+
+/// 100ns intervals between 1601 and 1970.
+static const constexpr std::int64_t unix_epoch = 116444736000000000;
+
+std::int64_t unix_time(const FILETIME & from) {
+	return ((static_cast<std::int64_t>(from.dwHighDateTime) << 32 | from.dwLowDateTime) - unix_epoch) / 10000000;
+}
+
+FILETIME unix_to_filetime(std::int64_t from) {
+	const auto ticks = static_cast<std::uint64_t>(from * 10000000 + unix_epoch);
+	FILETIME ret;
+	ret.dwHighDateTime = ticks >> 32;
+	ret.dwLowDateTime  = ticks & 0xFFFFFFFF;
+	return ret;
+}
+
+std::string ansi_to_utf8(const std::string & from) {
+	return recode(from, CP_ACP, CP_UTF8);
+}
+
+std::string utf8_to_ansi(const std::string & from) {
+	return recode(from, CP_UTF8, CP_ACP);
 }
 
 bool file_exists(const char * path) {
@@ -96,6 +208,16 @@ bool file_exists(const char * path) {
 	return f;
 }
 
+std::optional<std::string> read_file(const char * fname) {
+	std::ifstream in(fname, std::ios::binary);
+	if(!in)
+		return std::nullopt;
+	std::string ret{std::istreambuf_iterator<char>{in}, {}};
+	if(in.bad())
+		return std::nullopt;
+	return ret;
+}
+
 std::string config_file() {
 	return whereami::module_dir() += "/totalcmd-zstd.json";
 }
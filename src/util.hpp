@@ -29,8 +29,13 @@
 #endif
 #include <windows.h>
 
+#include <cstddef>
+#include <cstdint>
 #include <ctime>
+#include <optional>
+#include <streambuf>
 #include <string>
+#include <string_view>
 
 
 /// FileTime contains the date and the time of the file’s last update. Use the following algorithm to set the value:
@@ -44,10 +49,51 @@
 ///   * hour is in the 24 hour format
 int totalcmd_time(const FILETIME & from);
 
+/// Throws away everything written, for PK_TEST.
+struct null_streambuf : std::streambuf {
+	int_type overflow(int_type c) override { return c; }
+	std::streamsize xsputn(const char_type *, std::streamsize count) override { return count; }
+};
+
+/// Formats told apart by their magic numbers.
+enum class file_format { unknown, zstd, gzip, xz, lz4 };
+
+/// Return value: the format of the data starting with the specified bytes, at least 6 of them to tell them all apart.
+file_format detect_format(const void * data, std::size_t len);
+
+/// Return value: the format of the specified file, or unknown if it can't be read.
+file_format detect_format(const char * fname);
+
+/// Return value: whether the specified file is a zstd archive.
 bool verify_magic(const char * fname);
 
+/// Return value: the archive's file name without the zstd extension, or with .tar for .tzst.
+std::string guess_contained_name(const std::string & archive);
+
+/// Return value: whether the specified archive is named as a tarball, .tar.zst or .tzst.
+bool is_tarball_name(const std::string & archive);
+
+/// Return value: the specified name with ASCII letters lowercased, for comparing names like Windows does.
+std::string lowercase(std::string_view name);
+
+/// Return value: the last modification time of the specified file, if it could be read.
+std::optional<FILETIME> file_mtime(const char * fname);
+
+bool set_file_mtime(const char * fname, const FILETIME & mtime);
+
+/// Convert between FILETIMEs and seconds since the Unix epoch, as tar uses.
+std::int64_t unix_time(const FILETIME & from);
+FILETIME unix_to_filetime(std::int64_t from);
+
+/// Convert between the ANSI code page Total Commander passes names in and UTF-8, for JSON.
+std::string ansi_to_utf8(const std::string & from);
+std::string utf8_to_ansi(const std::string & from);
+
 bool file_exists(const char * fname);
 
+/// Return value: the whole content of the specified file, or nullopt if it couldn't be read.
+std::optional<std::string> read_file(const char * fname);
+
 std::string config_file();
 
 std::string totalcmd_config_file();
@@ -0,0 +1,57 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "worker_pool.hpp"
+#include "config.hpp"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+
+static std::atomic<std::size_t> live_shares;
+
+static std::size_t thread_budget() {
+	static const std::size_t budget = [] {
+		const configuration cfg;
+		return cfg.thread_budget ? cfg.thread_budget : std::max(std::thread::hardware_concurrency(), 1u);
+	}();
+	return budget;
+}
+
+
+worker_share::worker_share() {
+	++live_shares;
+}
+
+worker_share::~worker_share() {
+	--live_shares;
+}
+
+ZSTD_threadPool * worker_share::pool() const {
+	// Never freed: it'd be torn down from DllMain, under the loader lock, possibly after Windows already killed its threads
+	static ZSTD_threadPool * const pool = ZSTD_createThreadPool(thread_budget());
+	return pool;
+}
+
+std::size_t worker_share::workers() const {
+	return std::max<std::size_t>(thread_budget() / std::max<std::size_t>(live_shares, 1), 1);
+}
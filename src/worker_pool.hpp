@@ -0,0 +1,66 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+#include <zstd/zstd.h>
+
+
+/// A claim on the process-wide worker threads, held for the duration of one operation.
+///
+/// Total Commander runs packing and unpacking in the background, several at once, so the thread budget (all cores by default)
+/// is split evenly between whichever operations are live; their compression jobs all queue on the same ZSTD_threadPool.
+class worker_share {
+public:
+	worker_share();
+	~worker_share();
+	worker_share(const worker_share &) = delete;
+	worker_share(worker_share &&)      = delete;
+
+	/// Return value: the shared pool, created on first use with the configured thread budget, or nullptr if that failed.
+	ZSTD_threadPool * pool() const;
+
+	/// Return value: this operation's current share of the thread budget, at least 1.
+	std::size_t workers() const;
+};
+
+/// Call fn(0..count-1) on the specified operation's share of threads, without claiming another share for it.
+template <class F>
+void parallel_for(const worker_share & share, std::size_t count, F && fn) {
+	std::atomic<std::size_t> next{0};
+	const auto work = [&] {
+		for(std::size_t i; (i = next++) < count;)
+			fn(i);
+	};
+
+	std::vector<std::thread> threads(std::min(share.workers(), count));
+	for(auto && t : threads)
+		t = std::thread(work);
+	for(auto && t : threads)
+		t.join();
+}
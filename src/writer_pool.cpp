@@ -0,0 +1,121 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "writer_pool.hpp"
+#include "util.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <wcxhead.h>
+
+
+/// Queued files take up at most this much, or a quarter of the memory budget, if less.
+static const constexpr std::size_t max_queued_size = 64 * 1024 * 1024;
+
+
+/// Return value: 0, E_ECREATE or E_EWRITE.
+static int write_file(const std::string & path, const std::string & data, const std::optional<FILETIME> & mtime) {
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+	{
+		std::ofstream out(path, std::ios::binary);
+		if(!out)
+			return E_ECREATE;
+		if(!out.write(data.data(), data.size()).flush())
+			return E_EWRITE;
+	}
+	if(mtime)
+		set_file_mtime(path.c_str(), *mtime);
+	return 0;
+}
+
+
+writer_pool::writer_pool()
+      : max_queued(std::clamp<std::size_t>(memory.available() / 4, 1024 * 1024, max_queued_size)), queued(0), writing(0), submitted(0), stopping(false) {
+	memory.reserve(max_queued);
+	threads.reserve(share.workers());
+	for(std::size_t i = 0; i != share.workers(); ++i)
+		threads.emplace_back(&writer_pool::work, this);
+}
+
+writer_pool::~writer_pool() {
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	changed.notify_all();
+	for(auto && t : threads)
+		t.join();
+}
+
+std::size_t writer_pool::max_file_size() const {
+	// So there's always a few to go around
+	return max_queued / 4;
+}
+
+void writer_pool::work() {
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		changed.wait(guard, [&] { return stopping || !jobs.empty(); });
+		if(jobs.empty())
+			return;
+
+		auto cur = std::move(jobs.front());
+		jobs.pop_front();
+		++writing;
+
+		guard.unlock();
+		const auto err = write_file(cur.path, cur.data, cur.mtime);
+		guard.lock();
+
+		--writing;
+		queued -= cur.data.size();
+		paths.erase(paths.find(cur.path));
+		if(err && (!first_error || cur.index < first_error->first))
+			first_error.emplace(cur.index, err);
+		changed.notify_all();
+	}
+}
+
+void writer_pool::write(std::string path, std::string data, std::optional<FILETIME> mtime) {
+	std::unique_lock<std::mutex> guard(lock);
+	// One larger than the limit still goes through, on its own
+	changed.wait(guard, [&] { return (queued + data.size() <= max_queued && !paths.count(path)) || (jobs.empty() && !writing); });
+
+	queued += data.size();
+	paths.emplace(path);
+	jobs.push_back({submitted++, std::move(path), std::move(data), mtime});
+	changed.notify_all();
+}
+
+void writer_pool::wait_for(const std::string & path) {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] { return !paths.count(path); });
+}
+
+int writer_pool::wait() {
+	std::unique_lock<std::mutex> guard(lock);
+	changed.wait(guard, [&] { return jobs.empty() && !writing; });
+	return first_error ? first_error->second : 0;
+}
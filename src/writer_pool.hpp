@@ -0,0 +1,100 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#define WIN32_LEAN_AND_MEAN
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+
+#include "memory_budget.hpp"
+#include "worker_pool.hpp"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+
+/// Creates, writes and closes files on threads of its own, so extracting many small files isn't bound by one thread's syscalls.
+///
+/// Files are queued whole, up to a share of the memory budget at a time; queuing more waits for room.
+/// Failures are reported by wait(), the same one however the writes were scheduled.
+class writer_pool {
+private:
+	struct job {
+		std::uint64_t index;
+		std::string path;
+		std::string data;
+		std::optional<FILETIME> mtime;
+	};
+
+	worker_share share;
+	memory_reservation memory;
+	std::size_t max_queued;
+
+	std::mutex lock;
+	std::condition_variable changed;
+	std::deque<job> jobs;
+	std::size_t queued, writing;
+	/// Of the files queued or being written.
+	std::unordered_multiset<std::string> paths;
+	std::uint64_t submitted;
+	bool stopping;
+	/// {index, error} of the earliest-queued write to fail.
+	std::optional<std::pair<std::uint64_t, int>> first_error;
+	std::vector<std::thread> threads;
+
+	void work();
+
+
+public:
+	writer_pool();
+	/// Waits for the writes still queued.
+	~writer_pool();
+	writer_pool(const writer_pool &) = delete;
+	writer_pool(writer_pool &&)      = delete;
+
+	/// Return value: the largest file worth queuing; larger ones should be streamed out directly instead.
+	std::size_t max_file_size() const;
+
+	/// Queue the specified file to be written, creating the directories it's in, and its modification time set, if any.
+	///
+	/// A file already queued under the same path is written first, so the last one wins, like it would extracting in order.
+	void write(std::string path, std::string data, std::optional<FILETIME> mtime);
+
+	/// Wait for the files queued under the specified path to be written, before it's written some other way.
+	void wait_for(const std::string & path);
+
+	/// Wait for everything queued to be written.
+	///
+	/// Return value: E_ECREATE or E_EWRITE for the earliest-queued file that failed, 0 if none did.
+	int wait();
+};
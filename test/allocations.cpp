@@ -0,0 +1,75 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "test.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+
+// Everything allocated with new in the plugin goes through these; the zstd library's own allocations, with malloc(), don't
+static std::atomic<std::uint64_t> allocated_count{0}, allocated_bytes{0};
+
+void * operator new(std::size_t size) {
+	allocated_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if(const auto ret = std::malloc(size ? size : 1))
+		return ret;
+	throw std::bad_alloc{};
+}
+
+void * operator new[](std::size_t size) {
+	return ::operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t &) noexcept {
+	try {
+		return ::operator new(size);
+	} catch(const std::bad_alloc &) {
+		return nullptr;
+	}
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+	return ::operator new(size, std::nothrow);
+}
+
+void operator delete(void * ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr) noexcept {
+	std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+void operator delete[](void * ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+
+allocation_count allocations() {
+	return {allocated_count.load(), allocated_bytes.load()};
+}
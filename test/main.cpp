@@ -0,0 +1,152 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "test.hpp"
+#include "../src/util.hpp"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <zstd/zstd.h>
+
+
+static std::size_t failed = 0;
+static std::size_t checks = 0;
+
+
+bool check(bool ok, std::string_view what) {
+	++checks;
+	if(!ok) {
+		std::fprintf(stderr, "FAILED: %.*s\n", static_cast<int>(what.size()), what.data());
+		++failed;
+	}
+	return ok;
+}
+
+std::size_t failures() {
+	return failed;
+}
+
+
+std::string generate_corpus(std::size_t len, std::uint32_t seed) {
+	static const char * const words[] = {"the",  "of",   "and",  "to",     "in",     "is",      "that",    "for",      "archive", "frame",
+	                                     "data", "file", "size", "packed", "window", "request", "handled", "returned", "error",   "value"};
+
+	// Raw draws only: the distributions aren't the same everywhere
+	std::mt19937 rng(seed);
+	std::string ret;
+	ret.reserve(len + 64 * 1024);
+	while(ret.size() < len) {
+		const auto run = 1 + rng() % (64 * 1024);
+		switch(rng() % 3) {
+			case 0:  // Text
+				for(const auto end = ret.size() + run; ret.size() < end;) {
+					ret += words[rng() % std::size(words)];
+					ret += rng() % 12 ? ' ' : '\n';
+				}
+				break;
+			case 1:  // Records, slowly changing
+				for(std::uint32_t i = 0, id = rng(); i < run / 8; ++i) {
+					const std::uint32_t record[] = {id + i, static_cast<std::uint32_t>(rng() % 16)};
+					char bytes[sizeof(record)];
+					std::memcpy(bytes, record, sizeof(record));
+					ret.append(bytes, sizeof(bytes));
+				}
+				break;
+			default:  // Incompressible
+				for(std::size_t i = 0; i != run; ++i)
+					ret += static_cast<char>(rng());
+		}
+	}
+	ret.resize(len);
+	return ret;
+}
+
+configuration base_configuration() {
+	std::error_code ec;
+	std::filesystem::remove(config_file(), ec);
+
+	configuration ret;
+	ret.autotune      = autotune_goal::off;
+	ret.thread_budget = 2;
+	return ret;
+}
+
+const std::string & scratch_dir() {
+	static const std::string dir = (std::filesystem::temp_directory_path() / "totalcmd-zstd-test" / "").string();
+	return dir;
+}
+
+std::string read_whole(const std::string & path) {
+	std::ifstream in(path, std::ios::binary);
+	return {std::istreambuf_iterator<char>{in}, {}};
+}
+
+void write_whole(const std::string & path, const std::string & data) {
+	std::ofstream(path, std::ios::binary).write(data.data(), data.size());
+}
+
+std::optional<std::string> stock_decompress(const std::string & archive) {
+	std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)> ctx{ZSTD_createDStream(), ZSTD_freeDStream};
+	ZSTD_DCtx_setParameter(ctx.get(), ZSTD_d_windowLogMax, ZSTD_WINDOWLOG_MAX);
+
+	std::string ret;
+	char buf[16 * 1024];
+	std::size_t res = 0;
+	for(ZSTD_inBuffer in{archive.data(), archive.size(), 0}; in.pos != in.size || res > 0;) {
+		ZSTD_outBuffer out{buf, sizeof(buf), 0};
+		res = ZSTD_decompressStream(ctx.get(), &out, &in);
+		if(ZSTD_isError(res) || (!out.pos && in.pos == in.size && res > 0))  // Cut off
+			return std::nullopt;
+		ret.append(buf, out.pos);
+	}
+	return ret;
+}
+
+
+/// The baseline's allocations are compared with, its throughput as well with --throughput, or, with --record, it's written to.
+int main(int argc, char ** argv) {
+	const bool record = argc == 3 && !std::strcmp(argv[2], "--record"), throughput = argc == 3 && !std::strcmp(argv[2], "--throughput");
+	if(argc < 2 || argc > 3 || (argc == 3 && !record && !throughput)) {
+		std::fprintf(stderr, "Usage: %s baseline.json [--record|--throughput]\n", argv[0]);
+		return 2;
+	}
+
+	std::error_code ec;
+	std::filesystem::remove_all(scratch_dir(), ec);
+	std::filesystem::create_directories(scratch_dir());
+
+	// Next to the executable; the thread budget's only read the first time
+	if(!check(base_configuration().save(), "writing " + config_file()))
+		return 1;
+
+	round_trip_tests();
+	performance_tests(argv[1], record, throughput);
+
+	std::filesystem::remove_all(scratch_dir(), ec);
+	std::filesystem::remove(config_file(), ec);
+	std::printf("%zu of %zu failed\n", failures(), checks);
+	return failures() != 0;
+}
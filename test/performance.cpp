@@ -0,0 +1,163 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "test.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <nlohmann/json.hpp>
+
+
+/// Throughput's the best of this many runs, and allocations the fewest.
+static const constexpr std::size_t runs = 3;
+/// Allocations can be this many over the baseline however few there are, for threads finishing in a different order.
+static const constexpr std::uint64_t allocation_slack = 16;
+
+
+namespace {
+	struct measurement {
+		/// In MB/s of uncompressed data.
+		double throughput;
+		std::uint64_t allocations;
+	};
+}
+
+static std::optional<measurement> measure(const char * name, std::size_t len, const std::function<int()> & operation) {
+	measurement ret{0, std::numeric_limits<std::uint64_t>::max()};
+	for(std::size_t run = 0; run != runs; ++run) {
+		const auto allocated_before = allocations().count;
+		const auto start            = std::chrono::steady_clock::now();
+		const auto err              = operation();
+		const auto elapsed          = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if(!check(!err, std::string(name) + ": failed with " + std::to_string(err)))
+			return std::nullopt;
+
+		ret.throughput  = std::max(ret.throughput, len / 1e6 / elapsed);
+		ret.allocations = std::min(ret.allocations, allocations().count - allocated_before);
+	}
+	return ret;
+}
+
+
+void performance_tests(const char * baseline_path, bool record, bool throughput) {
+	auto cfg = base_configuration();
+	cfg.save();
+
+	// Past one_shot_threshold, so it's streamed
+	const auto len     = std::size_t{64} << 20;
+	const auto data    = generate_corpus(len, 0);
+	const auto source  = scratch_dir() + "corpus.bin";
+	const auto archive = source + ".zst", out = scratch_dir() + "extracted.bin";
+	write_whole(source, data);
+	char add[] = "corpus.bin\0";
+
+	tOpenArchiveData open{};
+	open.ArcName  = const_cast<char *>(archive.c_str());
+	open.OpenMode = PK_OM_EXTRACT;
+	tHeaderDataEx header{};
+
+	std::string buffer(64 * 1024, '\0');
+	const std::pair<const char *, std::function<int()>> operations[] = {
+	    {"pack‐files",
+	     [&] {
+		     std::remove(archive.c_str());
+		     return PackFiles(const_cast<char *>(archive.c_str()), nullptr, const_cast<char *>(scratch_dir().c_str()), add, 0);
+	     }},
+	    {"pack‐to‐mem",
+	     [&] {
+		     char name[]     = "corpus.bin";
+		     const auto pack = StartMemPack(0, name);
+		     auto res        = MEMPACK_OK;
+		     for(std::size_t taken_total = 0; res == MEMPACK_OK;) {
+			     const auto in_len = static_cast<int>(std::min(data.size() - taken_total, buffer.size()));
+			     int taken, written;
+			     res = PackToMem(pack, const_cast<char *>(data.data()) + taken_total, in_len, &taken, buffer.data(), buffer.size(), &written, 0);
+			     taken_total += taken;
+		     }
+		     DoneMemPack(pack);
+		     return res == MEMPACK_DONE ? 0 : res;
+	     }},
+	    {"extract",
+	     [&] {
+		     const auto handle = OpenArchive(&open);
+		     ReadHeaderEx(handle, &header);
+		     const auto err = ProcessFile(handle, PK_EXTRACT, nullptr, const_cast<char *>(out.c_str()));
+		     CloseArchive(handle);
+		     return err;
+	     }},
+	    {"read‐content",
+	     [&] {
+		     const auto handle = OpenArchive(&open);
+		     ReadHeaderEx(handle, &header);
+		     int err = 0, read = buffer.size();
+		     while(!err && read == static_cast<int>(buffer.size()))
+			     err = ReadArchiveContent(handle, buffer.data(), buffer.size(), &read);
+		     CloseArchive(handle);
+		     return err;
+	     }},
+	};
+
+	std::ifstream baseline_in(baseline_path);
+	auto baseline = nlohmann::ordered_json::parse(baseline_in, nullptr, false);
+	baseline_in.close();
+	if(!baseline.is_object()) {
+		if(!check(record, std::string("reading ") + baseline_path + "; record one with --record"))
+			return;
+		baseline = {{"tolerance", {{"throughput", 0.5}, {"allocations", 0.25}}},
+		            {"tolerance-comment",
+		             "Fraction of the baseline throughput it may drop by, and of the baseline allocations it may go over by, before failing. "
+		             "Throughput's only comparable on the machine it was recorded on, so it's only checked with --throughput: re-record it there with --record first."}};
+	}
+	const auto throughput_tolerance = baseline["tolerance"].value("throughput", 0.5), allocation_tolerance = baseline["tolerance"].value("allocations", 0.25);
+
+	for(auto && [name, operation] : operations) {
+		const auto measured = measure(name, len, operation);
+		if(!measured)
+			continue;
+
+		if(record) {
+			baseline[name] = {{"throughput", std::round(measured->throughput * 10) / 10}, {"allocations", measured->allocations}};
+			std::printf("%s: %.1f MB/s, %llu allocations\n", name, measured->throughput, static_cast<unsigned long long>(measured->allocations));
+			continue;
+		}
+
+		const auto & base = baseline[name];
+		if(!check(base.is_object(), std::string("no baseline for ") + name + "; record one with --record"))
+			continue;
+		const auto base_throughput  = base.value("throughput", 0.);
+		const auto base_allocations = base.value("allocations", std::uint64_t{});
+		std::printf("%s: %.1f MB/s (baseline %.1f), %llu allocations (baseline %llu)\n", name, measured->throughput, base_throughput,
+		            static_cast<unsigned long long>(measured->allocations), static_cast<unsigned long long>(base_allocations));
+		if(throughput)
+			check(measured->throughput >= base_throughput * (1 - throughput_tolerance), std::string(name) + ": throughput regressed past the baseline");
+		check(measured->allocations <= base_allocations * (1 + allocation_tolerance) + allocation_slack,
+		      std::string(name) + ": allocations regressed past the baseline");
+	}
+
+	check(read_whole(out) == data, "extracted something else");
+	if(record)
+		check(static_cast<bool>(std::ofstream(baseline_path) << baseline.dump(2) << '\n'), std::string("writing ") + baseline_path);
+}
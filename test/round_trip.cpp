@@ -0,0 +1,144 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include "test.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <zstd/zstd.h>
+
+
+/// Lengths just either side of where the buffers and frames split: the zstd block size, ZSTD_CStreamInSize(), and one_shot_threshold and frame_size of 1 MiB.
+static const constexpr std::size_t edge_lengths[] = {0, 1, 2, 131071, 131072, 131073, (1 << 20) - 1, 1 << 20, (1 << 20) + 1, 3 * (1 << 20) + 5};
+
+
+/// Pack with InLen and OutLen random up to max_in and max_out, then decode with the zstd library.
+static void pack_to_mem(const std::string & data, std::mt19937 & rng, int max_in, int max_out, const std::string & what) {
+	char name[] = "corpus.bin";
+	const auto pack = StartMemPack(0, name);
+	if(!check(pack, what + ": StartMemPack()"))
+		return;
+
+	std::string packed, out(max_out, '\0');
+	std::size_t taken_total = 0;
+	for(std::size_t calls = 0;; ++calls) {
+		const auto in_len  = static_cast<int>(std::min<std::size_t>(data.size() - taken_total, 1 + rng() % max_in));
+		const auto out_len = static_cast<int>(1 + rng() % max_out);
+		int taken = 0, written = 0;
+		const auto res = PackToMem(pack, const_cast<char *>(data.data()) + taken_total, in_len, &taken, out.data(), out_len, &written, 0);
+		if(!check(res == MEMPACK_OK || res == MEMPACK_DONE, what + ": PackToMem() returned " + std::to_string(res)) ||
+		   !check(taken >= 0 && taken <= in_len && written >= 0 && written <= out_len, what + ": PackToMem() took or wrote past the buffers") ||
+		   !check(calls < 4 * (data.size() + packed.size()) + 1024, what + ": PackToMem() stopped making progress"))
+			break;
+
+		taken_total += taken;
+		packed.append(out.data(), written);
+		if(res == MEMPACK_DONE)
+			break;
+	}
+	DoneMemPack(pack);
+
+	const auto decoded = stock_decompress(packed);
+	check(decoded == data, what + ": decoded by libzstd to something else");
+}
+
+/// Extract the archive whole, test it, and read it in pieces random up to max_piece, comparing with data.
+static void unpack(const std::string & archive, const std::string & data, std::mt19937 & rng, int max_piece, const std::string & what) {
+	tOpenArchiveData open{};
+	open.ArcName  = const_cast<char *>(archive.c_str());
+	open.OpenMode = PK_OM_EXTRACT;
+	tHeaderDataEx header{};
+
+	const auto out = scratch_dir() + "extracted.bin";
+	auto handle    = OpenArchive(&open);
+	if(!check(handle && ReadHeaderEx(handle, &header) == 0, what + ": OpenArchive()"))
+		return;
+	const auto extracted = ProcessFile(handle, PK_EXTRACT, nullptr, const_cast<char *>(out.c_str()));
+	CloseArchive(handle);
+	check(extracted == 0 && read_whole(out) == data, what + ": extracted to something else");
+
+	handle = OpenArchive(&open);
+	ReadHeaderEx(handle, &header);
+	check(ProcessFile(handle, PK_TEST, nullptr, nullptr) == 0, what + ": PK_TEST failed");
+	CloseArchive(handle);
+
+	handle = OpenArchive(&open);
+	ReadHeaderEx(handle, &header);
+	std::string content, piece(max_piece, '\0');
+	int err = 0;
+	for(int size = max_piece, read = size; read == size && !err;) {
+		size = 1 + rng() % max_piece;
+		err  = ReadArchiveContent(handle, piece.data(), size, &read);
+		content.append(piece.data(), read);
+	}
+	CloseArchive(handle);
+	check(!err && content == data, what + ": ReadArchiveContent() read something else");
+}
+
+
+void round_trip_tests() {
+	std::mt19937 rng(47);
+
+	// Splitting into frames and flushing change where the buffers end
+	for(std::size_t round = 0; round != 40; ++round) {
+		auto cfg                = base_configuration();
+		cfg.compression_level   = 1 + round % 5;
+		cfg.frame_size          = round % 3 == 0 ? 1 : 0;
+		cfg.flush_interval_size = round % 4 == 1 ? 64 : 0;
+		cfg.save();
+
+		const bool tiny_in = round % 2, tiny_out = round % 5 == 0;
+		const auto len     = round < std::size(edge_lengths) ? edge_lengths[round] : rng() % (tiny_in ? 256 * 1024 : 3 << 20);
+		const auto max_in  = tiny_in ? 7 : 128 * 1024, max_out = tiny_out ? 3 : round % 2 ? 100 : 128 * 1024;
+		pack_to_mem(generate_corpus(len, round), rng, max_in, max_out,
+		            "PackToMem(), " + std::to_string(len) + " bytes, InLen ≤" + std::to_string(max_in) + ", OutLen ≤" + std::to_string(max_out));
+	}
+
+	auto cfg               = base_configuration();
+	cfg.one_shot_threshold = 1;
+	cfg.frame_size         = 1;
+	cfg.sha256             = true;
+	cfg.save();
+
+	const auto source = scratch_dir() + "corpus.bin", archive = source + ".zst";
+	char add[]        = "corpus.bin\0";
+	for(auto len : edge_lengths) {
+		const auto data = generate_corpus(len, len);
+		write_whole(source, data);
+
+		// Ours, in frames of 1 MiB
+		std::remove(archive.c_str());
+		const auto what = std::to_string(len) + " bytes";
+		if(check(PackFiles(const_cast<char *>(archive.c_str()), nullptr, const_cast<char *>(scratch_dir().c_str()), add, 0) == 0, "PackFiles(), " + what)) {
+			check(stock_decompress(read_whole(archive)) == data, "PackFiles(), " + what + ": decoded by libzstd to something else");
+			unpack(archive, data, rng, 9, "packed by PackFiles(), " + what + ", in pieces ≤9");
+			unpack(archive, data, rng, 256 * 1024, "packed by PackFiles(), " + what + ", in pieces ≤256 KiB");
+		}
+
+		// The zstd library's own, in one frame
+		std::string stock(ZSTD_compressBound(len), '\0');
+		stock.resize(ZSTD_compress(stock.data(), stock.size(), data.data(), data.size(), 3));
+		write_whole(archive, stock);
+		unpack(archive, data, rng, 9, "packed by libzstd, " + what + ", in pieces ≤9");
+		unpack(archive, data, rng, 256 * 1024, "packed by libzstd, " + what + ", in pieces ≤256 KiB");
+	}
+}
@@ -0,0 +1,140 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <bcrypt.h>
+#include <algorithm>
+#include <cstring>
+#include <cwchar>
+
+
+namespace {
+	/// FIPS 180-4.
+	class sha256 {
+	private:
+		static const constexpr std::uint32_t round_constants[64] = {
+		    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be,
+		    0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa,
+		    0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85,
+		    0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+		    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f,
+		    0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+		std::uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+		unsigned char block[64];
+		std::size_t block_len = 0;
+		std::uint64_t total   = 0;
+
+		static std::uint32_t rotr(std::uint32_t x, int n) { return x >> n | x << (32 - n); }
+
+		void compress() {
+			std::uint32_t w[64];
+			for(int i = 0; i != 16; ++i)
+				w[i] = static_cast<std::uint32_t>(block[i * 4]) << 24 | block[i * 4 + 1] << 16 | block[i * 4 + 2] << 8 | block[i * 4 + 3];
+			for(int i = 16; i != 64; ++i)
+				w[i] = w[i - 16] + (rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ w[i - 15] >> 3) + w[i - 7] + (rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ w[i - 2] >> 10);
+
+			auto [a, b, c, d, e, f, g, h] = state;
+			for(int i = 0; i != 64; ++i) {
+				const auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + round_constants[i] + w[i];
+				const auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+				h             = g;
+				g             = f;
+				f             = e;
+				e             = d + t1;
+				d             = c;
+				c             = b;
+				b             = a;
+				a             = t1 + t2;
+			}
+			const std::uint32_t add[] = {a, b, c, d, e, f, g, h};
+			for(int i = 0; i != 8; ++i)
+				state[i] += add[i];
+		}
+
+	public:
+		void update(const unsigned char * data, std::size_t len) {
+			total += len;
+			while(len) {
+				const auto piece = std::min(len, sizeof(block) - block_len);
+				std::memcpy(block + block_len, data, piece);
+				block_len += piece;
+				data += piece;
+				len -= piece;
+				if(block_len == sizeof(block)) {
+					compress();
+					block_len = 0;
+				}
+			}
+		}
+
+		void finish(unsigned char (&digest)[32]) {
+			const auto bits                = total * 8;
+			static const unsigned char pad = 0x80, zero = 0;
+			update(&pad, 1);
+			while(block_len != 56)
+				update(&zero, 1);
+			for(int i = 7; i >= 0; --i) {
+				const unsigned char byte = bits >> (i * 8);
+				update(&byte, 1);
+			}
+			for(int i = 0; i != 32; ++i)
+				digest[i] = state[i / 4] >> (24 - i % 4 * 8);
+		}
+	};
+
+	/// BCRYPT_ALG_HANDLEs only need to be non-null.
+	char sha256_algorithm;
+}
+
+
+NTSTATUS BCryptOpenAlgorithmProvider(BCRYPT_ALG_HANDLE * algorithm, const WCHAR * id, const WCHAR *, ULONG) {
+	if(std::wcscmp(id, BCRYPT_SHA256_ALGORITHM))
+		return static_cast<NTSTATUS>(0xC00000BB);  // STATUS_NOT_SUPPORTED
+	*algorithm = &sha256_algorithm;
+	return 0;
+}
+
+NTSTATUS BCryptCloseAlgorithmProvider(BCRYPT_ALG_HANDLE, ULONG) {
+	return 0;
+}
+
+NTSTATUS BCryptCreateHash(BCRYPT_ALG_HANDLE, BCRYPT_HASH_HANDLE * hash, PUCHAR, ULONG, PUCHAR, ULONG, ULONG) {
+	*hash = new sha256;
+	return 0;
+}
+
+NTSTATUS BCryptHashData(BCRYPT_HASH_HANDLE hash, PUCHAR data, ULONG len, ULONG) {
+	static_cast<sha256 *>(hash)->update(data, len);
+	return 0;
+}
+
+NTSTATUS BCryptFinishHash(BCRYPT_HASH_HANDLE hash, PUCHAR digest, ULONG len, ULONG) {
+	unsigned char whole[32];
+	static_cast<sha256 *>(hash)->finish(whole);
+	std::memcpy(digest, whole, std::min<std::size_t>(len, sizeof(whole)));
+	return len == sizeof(whole) ? 0 : static_cast<NTSTATUS>(0xC000000D);  // STATUS_INVALID_PARAMETER
+}
+
+NTSTATUS BCryptDestroyHash(BCRYPT_HASH_HANDLE hash) {
+	delete static_cast<sha256 *>(hash);
+	return 0;
+}
@@ -0,0 +1,585 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#include <windows.h>
+#include <shellapi.h>
+#include <winioctl.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <cwchar>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+
+namespace {
+	/// What HANDLEs point to; CloseHandle() deletes them.
+	struct object {
+		virtual ~object() = default;
+	};
+
+	struct file : object {
+		int fd;
+
+		explicit file(int fd) : fd(fd) {}
+		~file() { close(fd); }
+	};
+
+	/// Of the file's size when created, if given none; views of it are mmap()ed from its own descriptor.
+	struct mapping : file {
+		std::uint64_t size;
+		bool writable;
+
+		mapping(int fd, std::uint64_t size, bool writable) : file(fd), size(size), writable(writable) {}
+	};
+
+	struct event : object {
+		std::mutex lock;
+		std::condition_variable changed;
+		bool manual_reset, set;
+
+		event(bool manual_reset, bool set) : manual_reset(manual_reset), set(set) {}
+	};
+
+	thread_local DWORD last_error = ERROR_SUCCESS;
+
+	std::mutex views_lock;
+	std::unordered_map<const void *, std::size_t> views;
+
+	/// 100ns intervals between 1601 and 1970.
+	const constexpr std::int64_t unix_epoch = 116444736000000000;
+
+
+	BOOL fail(DWORD error) {
+		last_error = error;
+		return FALSE;
+	}
+
+	/// Return value: FALSE, with the last error set to the closest to errno.
+	BOOL fail_errno() {
+		switch(errno) {
+			case ENOENT:
+			case ENOTDIR:
+				return fail(ERROR_FILE_NOT_FOUND);
+			case EACCES:
+			case EPERM:
+			case EISDIR:
+				return fail(ERROR_ACCESS_DENIED);
+			default:
+				return fail(ERROR_INVALID_PARAMETER);
+		}
+	}
+
+	template <class T>
+	T * as(HANDLE handle) {
+		return handle && handle != INVALID_HANDLE_VALUE ? dynamic_cast<T *>(static_cast<object *>(handle)) : nullptr;
+	}
+
+	FILETIME to_filetime(const timespec & from) {
+		const auto time = unix_epoch + static_cast<std::int64_t>(from.tv_sec) * 10000000 + from.tv_nsec / 100;
+		return {static_cast<DWORD>(time), static_cast<DWORD>(static_cast<std::uint64_t>(time) >> 32)};
+	}
+
+	timespec from_filetime(const FILETIME & from) {
+		const auto time = static_cast<std::int64_t>(static_cast<std::uint64_t>(from.dwHighDateTime) << 32 | from.dwLowDateTime) - unix_epoch;
+		return {static_cast<time_t>(time / 10000000), static_cast<long>(time % 10000000 * 100)};
+	}
+
+	off_t offset_of(const OVERLAPPED & overlapped) {
+		return static_cast<std::uint64_t>(overlapped.OffsetHigh) << 32 | overlapped.Offset;
+	}
+
+	/// Windows reads and writes all of it unless it hits the end of the file.
+	template <class F>
+	ssize_t whole(std::size_t len, F && transfer) {
+		std::size_t done = 0;
+		while(done != len) {
+			const auto res = transfer(done);
+			if(res < 0 && errno == EINTR)
+				continue;
+			if(res < 0)
+				return -1;
+			if(res == 0)
+				break;
+			done += res;
+		}
+		return done;
+	}
+}
+
+
+DWORD GetLastError() {
+	return last_error;
+}
+
+BOOL CloseHandle(HANDLE handle) {
+	const auto closing = as<object>(handle);
+	if(!closing)
+		return fail(ERROR_INVALID_PARAMETER);
+	delete closing;
+	return TRUE;
+}
+
+
+HANDLE CreateFileA(LPCSTR name, DWORD access, DWORD, void *, DWORD disposition, DWORD flags, HANDLE) {
+	int mode = (access & GENERIC_READ) && (access & GENERIC_WRITE) ? O_RDWR : access & GENERIC_WRITE ? O_WRONLY : O_RDONLY;
+	switch(disposition) {
+		case CREATE_NEW:
+			mode |= O_CREAT | O_EXCL;
+			break;
+		case CREATE_ALWAYS:
+			mode |= O_CREAT | O_TRUNC;
+			break;
+		case OPEN_ALWAYS:
+			mode |= O_CREAT;
+			break;
+		case TRUNCATE_EXISTING:
+			mode |= O_TRUNC;
+			break;
+	}
+	if(flags & FILE_FLAG_WRITE_THROUGH)
+		mode |= O_DSYNC;
+
+	const auto fd = open(name, mode | O_CLOEXEC, 0666);
+	if(fd == -1) {
+		fail_errno();
+		return INVALID_HANDLE_VALUE;
+	}
+	// Gone from the directory now, and for good once closed
+	if(flags & FILE_FLAG_DELETE_ON_CLOSE)
+		unlink(name);
+	return static_cast<object *>(new struct file(fd));
+}
+
+/// Overlapped reads and writes are done there and then: nothing's ever pending, and the event's set right away.
+BOOL ReadFile(HANDLE handle, void * buf, DWORD len, DWORD * read, OVERLAPPED * overlapped) {
+	const auto from = as<struct file>(handle);
+	if(!from)
+		return fail(ERROR_INVALID_PARAMETER);
+
+	const auto into = static_cast<char *>(buf);
+	const auto res  = whole(len, [&](std::size_t done) {
+		return overlapped ? pread(from->fd, into + done, len - done, offset_of(*overlapped) + done) : ::read(from->fd, into + done, len - done);
+	});
+	if(res < 0)
+		return fail_errno();
+
+	if(read)
+		*read = res;
+	if(overlapped) {
+		overlapped->Internal     = res == 0 && len ? ERROR_HANDLE_EOF : ERROR_SUCCESS;
+		overlapped->InternalHigh = res;
+		if(overlapped->hEvent)
+			SetEvent(overlapped->hEvent);
+		if(overlapped->Internal)
+			return fail(overlapped->Internal);
+	}
+	return TRUE;
+}
+
+BOOL WriteFile(HANDLE handle, const void * buf, DWORD len, DWORD * written, OVERLAPPED * overlapped) {
+	const auto to = as<struct file>(handle);
+	if(!to)
+		return fail(ERROR_INVALID_PARAMETER);
+
+	const auto from = static_cast<const char *>(buf);
+	const auto res  = whole(len, [&](std::size_t done) {
+		return overlapped ? pwrite(to->fd, from + done, len - done, offset_of(*overlapped) + done) : ::write(to->fd, from + done, len - done);
+	});
+	if(res < 0)
+		return fail_errno();
+
+	if(written)
+		*written = res;
+	if(overlapped) {
+		overlapped->Internal     = ERROR_SUCCESS;
+		overlapped->InternalHigh = res;
+		if(overlapped->hEvent)
+			SetEvent(overlapped->hEvent);
+	}
+	return TRUE;
+}
+
+BOOL GetOverlappedResult(HANDLE, OVERLAPPED * overlapped, DWORD * transferred, BOOL) {
+	*transferred = overlapped->InternalHigh;
+	return overlapped->Internal ? fail(overlapped->Internal) : TRUE;
+}
+
+BOOL CancelIoEx(HANDLE, OVERLAPPED *) {
+	return TRUE;
+}
+
+BOOL FlushFileBuffers(HANDLE handle) {
+	const auto to = as<struct file>(handle);
+	return to && fsync(to->fd) == 0 ? TRUE : fail_errno();
+}
+
+BOOL GetFileSizeEx(HANDLE handle, LARGE_INTEGER * size) {
+	struct stat info;
+	const auto of = as<struct file>(handle);
+	if(!of || fstat(of->fd, &info))
+		return fail_errno();
+	size->QuadPart = info.st_size;
+	return TRUE;
+}
+
+BOOL SetFilePointerEx(HANDLE handle, LARGE_INTEGER distance, LARGE_INTEGER * position, DWORD method) {
+	const auto of = as<struct file>(handle);
+	if(!of)
+		return fail(ERROR_INVALID_PARAMETER);
+	const auto res = lseek(of->fd, distance.QuadPart, method == FILE_BEGIN ? SEEK_SET : method == FILE_CURRENT ? SEEK_CUR : SEEK_END);
+	if(res == -1)
+		return fail_errno();
+	if(position)
+		position->QuadPart = res;
+	return TRUE;
+}
+
+BOOL SetEndOfFile(HANDLE handle) {
+	const auto of = as<struct file>(handle);
+	if(!of)
+		return fail(ERROR_INVALID_PARAMETER);
+	return ftruncate(of->fd, lseek(of->fd, 0, SEEK_CUR)) == 0 ? TRUE : fail_errno();
+}
+
+/// Only the modification time's kept; it's returned for all three.
+BOOL GetFileTime(HANDLE handle, FILETIME * creation, FILETIME * access, FILETIME * write) {
+	struct stat info;
+	const auto of = as<struct file>(handle);
+	if(!of || fstat(of->fd, &info))
+		return fail_errno();
+	for(auto time : {creation, access, write})
+		if(time)
+			*time = to_filetime(info.st_mtim);
+	return TRUE;
+}
+
+BOOL SetFileTime(HANDLE handle, const FILETIME *, const FILETIME * access, const FILETIME * write) {
+	const auto of = as<struct file>(handle);
+	if(!of)
+		return fail(ERROR_INVALID_PARAMETER);
+	const timespec times[] = {access ? from_filetime(*access) : timespec{0, UTIME_OMIT}, write ? from_filetime(*write) : timespec{0, UTIME_OMIT}};
+	return futimens(of->fd, times) == 0 ? TRUE : fail_errno();
+}
+
+/// Files with fewer blocks than their size are taken to be sparse.
+DWORD GetFileAttributesA(LPCSTR name) {
+	struct stat info;
+	if(stat(name, &info)) {
+		fail_errno();
+		return INVALID_FILE_ATTRIBUTES;
+	}
+	if(S_ISDIR(info.st_mode))
+		return FILE_ATTRIBUTE_DIRECTORY;
+	return static_cast<std::uint64_t>(info.st_blocks) * 512 < static_cast<std::uint64_t>(info.st_size) ? FILE_ATTRIBUTE_SPARSE_FILE : FILE_ATTRIBUTE_NORMAL;
+}
+
+BOOL GetFileAttributesExA(LPCSTR name, GET_FILEEX_INFO_LEVELS, void * info) {
+	struct stat status;
+	if(stat(name, &status))
+		return fail_errno();
+
+	const auto into        = static_cast<WIN32_FILE_ATTRIBUTE_DATA *>(info);
+	into->dwFileAttributes = GetFileAttributesA(name);
+	into->ftCreationTime = into->ftLastAccessTime = into->ftLastWriteTime = to_filetime(status.st_mtim);
+	into->nFileSizeHigh                                                   = static_cast<std::uint64_t>(status.st_size) >> 32;
+	into->nFileSizeLow                                                    = static_cast<DWORD>(status.st_size);
+	return TRUE;
+}
+
+DWORD GetTempPathA(DWORD len, LPSTR buf) {
+	std::string dir = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+	if(dir.back() != '/')
+		dir += '/';
+	if(dir.size() >= len)
+		return dir.size() + 1;
+	std::memcpy(buf, dir.c_str(), dir.size() + 1);
+	return dir.size();
+}
+
+/// Every file can have holes; the allocated ranges are where SEEK_DATA finds data, or all of it if the file system can't tell.
+BOOL DeviceIoControl(HANDLE handle, DWORD code, void * in, DWORD, void * out, DWORD out_len, DWORD * returned, OVERLAPPED *) {
+	const auto of = as<struct file>(handle);
+	if(!of)
+		return fail(ERROR_INVALID_PARAMETER);
+	*returned = 0;
+	if(code == FSCTL_SET_SPARSE)
+		return TRUE;
+	if(code != FSCTL_QUERY_ALLOCATED_RANGES)
+		return fail(ERROR_INVALID_PARAMETER);
+
+	const auto query  = static_cast<const FILE_ALLOCATED_RANGE_BUFFER *>(in);
+	const auto ranges = static_cast<FILE_ALLOCATED_RANGE_BUFFER *>(out);
+	const auto end    = query->FileOffset.QuadPart + query->Length.QuadPart;
+	DWORD found       = 0;
+	for(auto at = query->FileOffset.QuadPart; at < end;) {
+		auto data = lseek(of->fd, at, SEEK_DATA);
+		auto hole = data == -1 ? end : lseek(of->fd, data, SEEK_HOLE);
+		if(data == -1 && errno == ENXIO)  // Only holes from here on
+			break;
+		if(data == -1)
+			data = at;
+		if(data >= end)
+			break;
+		hole = std::min<off_t>(hole == -1 ? end : hole, end);
+
+		if((found + 1) * sizeof(*ranges) > out_len) {
+			*returned = found * sizeof(*ranges);
+			return fail(ERROR_MORE_DATA);
+		}
+		ranges[found].FileOffset.QuadPart = data;
+		ranges[found].Length.QuadPart     = hole - data;
+		++found;
+		at = hole;
+	}
+	*returned = found * sizeof(*ranges);
+	return TRUE;
+}
+
+
+HANDLE CreateFileMappingA(HANDLE handle, void *, DWORD protection, DWORD size_high, DWORD size_low, LPCSTR) {
+	const auto of = as<struct file>(handle);
+	struct stat info;
+	if(!of || fstat(of->fd, &info)) {
+		fail_errno();
+		return nullptr;
+	}
+
+	const auto size = size_high || size_low ? static_cast<std::uint64_t>(size_high) << 32 | size_low : static_cast<std::uint64_t>(info.st_size);
+	if(!size) {  // ERROR_FILE_INVALID
+		fail(ERROR_INVALID_PARAMETER);
+		return nullptr;
+	}
+	const auto fd = dup(of->fd);
+	if(fd == -1) {
+		fail_errno();
+		return nullptr;
+	}
+	return static_cast<object *>(new mapping(fd, size, protection == PAGE_READWRITE));
+}
+
+void * MapViewOfFile(HANDLE handle, DWORD access, DWORD offset_high, DWORD offset_low, std::size_t len) {
+	const auto of     = as<mapping>(handle);
+	const auto offset = static_cast<std::uint64_t>(offset_high) << 32 | offset_low;
+	if(!of || offset >= of->size || ((access & FILE_MAP_WRITE) && !of->writable)) {
+		fail(ERROR_ACCESS_DENIED);
+		return nullptr;
+	}
+	if(!len)
+		len = of->size - offset;
+
+	const auto view = mmap(nullptr, len, access & FILE_MAP_WRITE ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, of->fd, offset);
+	if(view == MAP_FAILED) {
+		fail_errno();
+		return nullptr;
+	}
+	std::lock_guard<std::mutex> guard(views_lock);
+	views.emplace(view, len);
+	return view;
+}
+
+BOOL UnmapViewOfFile(const void * view) {
+	std::lock_guard<std::mutex> guard(views_lock);
+	const auto itr = views.find(view);
+	if(itr == views.end())
+		return fail(ERROR_INVALID_PARAMETER);
+	munmap(const_cast<void *>(view), itr->second);
+	views.erase(itr);
+	return TRUE;
+}
+
+
+HANDLE CreateEventA(void *, BOOL manual_reset, BOOL initial_state, LPCSTR) {
+	return static_cast<object *>(new event(manual_reset, initial_state));
+}
+
+BOOL SetEvent(HANDLE handle) {
+	const auto setting = as<event>(handle);
+	if(!setting)
+		return fail(ERROR_INVALID_PARAMETER);
+	{
+		std::lock_guard<std::mutex> guard(setting->lock);
+		setting->set = true;
+	}
+	setting->changed.notify_all();
+	return TRUE;
+}
+
+DWORD WaitForSingleObject(HANDLE handle, DWORD timeout) {
+	const auto waiting = as<event>(handle);
+	if(!waiting) {
+		fail(ERROR_INVALID_PARAMETER);
+		return WAIT_FAILED;
+	}
+
+	std::unique_lock<std::mutex> guard(waiting->lock);
+	const auto is_set = [&] { return waiting->set; };
+	if(timeout == INFINITE)
+		waiting->changed.wait(guard, is_set);
+	else if(!waiting->changed.wait_for(guard, std::chrono::milliseconds(timeout), is_set))
+		return 0x102;  // WAIT_TIMEOUT
+	if(!waiting->manual_reset)
+		waiting->set = false;
+	return WAIT_OBJECT_0;
+}
+
+/// No window messages ever arrive: this just waits for the one object.
+DWORD MsgWaitForMultipleObjects(DWORD count, const HANDLE * objects, BOOL, DWORD timeout, DWORD) {
+	if(count != 1) {
+		fail(ERROR_INVALID_PARAMETER);
+		return WAIT_FAILED;
+	}
+	return WaitForSingleObject(objects[0], timeout);
+}
+
+BOOL PeekMessageA(MSG *, HWND, UINT, UINT, UINT) {
+	return FALSE;
+}
+
+BOOL TranslateMessage(const MSG *) {
+	return FALSE;
+}
+
+LRESULT DispatchMessageA(const MSG *) {
+	return 0;
+}
+
+void PostQuitMessage(int) {}
+
+/// Written to stderr instead, and "OK" pressed.
+int MessageBoxA(HWND, LPCSTR text, LPCSTR caption, UINT) {
+	std::fprintf(stderr, "%s: %s\n", caption ? caption : "Error", text);
+	return 1;  // IDOK
+}
+
+/// There's nothing to open anything with.
+HINSTANCE ShellExecuteA(HWND, LPCSTR, LPCSTR, LPCSTR, LPCSTR, int) {
+	return reinterpret_cast<HINSTANCE>(ERROR_FILE_NOT_FOUND);
+}
+
+
+BOOL FileTimeToSystemTime(const FILETIME * from, SYSTEMTIME * to) {
+	const auto time = from_filetime(*from);
+	tm broken;
+	if(!gmtime_r(&time.tv_sec, &broken))
+		return fail(ERROR_INVALID_PARAMETER);
+	*to = {static_cast<WORD>(broken.tm_year + 1900), static_cast<WORD>(broken.tm_mon + 1), static_cast<WORD>(broken.tm_wday), static_cast<WORD>(broken.tm_mday),
+	       static_cast<WORD>(broken.tm_hour),        static_cast<WORD>(broken.tm_min),     static_cast<WORD>(broken.tm_sec),  static_cast<WORD>(time.tv_nsec / 1000000)};
+	return TRUE;
+}
+
+/// The ANSI code page is taken to be Latin-1, the first 256 code points; anything past it is written as '?'.
+/// Invalid UTF-8 is decoded as U+FFFD, as Windows does.
+static std::wstring decode(UINT codepage, const unsigned char * from, std::size_t len) {
+	std::wstring ret;
+	for(std::size_t i = 0; i != len;) {
+		const unsigned char lead = from[i++];
+		if(codepage != CP_UTF8 || lead < 0x80) {
+			ret += static_cast<wchar_t>(lead);
+			continue;
+		}
+
+		const std::size_t continuations = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+		char32_t point                  = lead & (0x3F >> continuations);
+		std::size_t taken               = 0;
+		for(; taken != continuations && i != len && (from[i] & 0xC0) == 0x80; ++taken, ++i)
+			point = point << 6 | (from[i] & 0x3F);
+		const char32_t min = continuations == 3 ? 0x10000 : continuations == 2 ? 0x800 : 0x80;
+		ret += !continuations || taken != continuations || lead > 0xF4 || point < min || point > 0x10FFFF ? L'\uFFFD' : static_cast<wchar_t>(point);
+	}
+	return ret;
+}
+
+static std::string encode(UINT codepage, const WCHAR * from, std::size_t len) {
+	std::string ret;
+	for(std::size_t i = 0; i != len; ++i) {
+		const auto point = static_cast<char32_t>(from[i]);
+		if(codepage != CP_UTF8)
+			ret += point < 0x100 ? static_cast<char>(point) : '?';
+		else if(point < 0x80)
+			ret += static_cast<char>(point);
+		else if(point < 0x800)
+			ret += {static_cast<char>(0xC0 | point >> 6), static_cast<char>(0x80 | (point & 0x3F))};
+		else if(point < 0x10000)
+			ret += {static_cast<char>(0xE0 | point >> 12), static_cast<char>(0x80 | (point >> 6 & 0x3F)), static_cast<char>(0x80 | (point & 0x3F))};
+		else
+			ret += {static_cast<char>(0xF0 | point >> 18), static_cast<char>(0x80 | (point >> 12 & 0x3F)), static_cast<char>(0x80 | (point >> 6 & 0x3F)),
+			        static_cast<char>(0x80 | (point & 0x3F))};
+	}
+	return ret;
+}
+
+int MultiByteToWideChar(UINT codepage, DWORD, LPCSTR from, int from_len, WCHAR * to, int to_len) {
+	if(from_len < 0)
+		from_len = std::strlen(from) + 1;
+	const auto wide = decode(codepage, reinterpret_cast<const unsigned char *>(from), from_len);
+	if(!to_len)
+		return wide.size();
+	if(to_len < static_cast<int>(wide.size()))
+		return fail(ERROR_INVALID_PARAMETER);
+	std::copy(wide.begin(), wide.end(), to);
+	return wide.size();
+}
+
+int WideCharToMultiByte(UINT codepage, DWORD, const WCHAR * from, int from_len, LPSTR to, int to_len, LPCSTR, BOOL *) {
+	if(from_len < 0)
+		from_len = std::wcslen(from) + 1;
+	const auto narrow = encode(codepage, from, from_len);
+	if(!to_len)
+		return narrow.size();
+	if(to_len < static_cast<int>(narrow.size()))
+		return fail(ERROR_INVALID_PARAMETER);
+	std::copy(narrow.begin(), narrow.end(), to);
+	return narrow.size();
+}
+
+
+/// There's no registry: nothing's ever found in it.
+LSTATUS RegGetValueA(HKEY, LPCSTR, LPCSTR, DWORD, DWORD *, void *, DWORD *) {
+	return ERROR_FILE_NOT_FOUND;
+}
+
+DWORD ExpandEnvironmentStringsA(LPCSTR from, LPSTR to, DWORD len) {
+	std::string expanded;
+	for(auto cur = from; *cur;) {
+		const auto close = *cur == '%' ? std::strchr(cur + 1, '%') : nullptr;
+		const auto value = close ? std::getenv(std::string(cur + 1, close).c_str()) : nullptr;
+		if(value) {
+			expanded += value;
+			cur = close + 1;
+		} else
+			expanded += *cur++;
+	}
+
+	if(to && expanded.size() < len)
+		std::memcpy(to, expanded.c_str(), expanded.size() + 1);
+	return expanded.size() + 1;
+}
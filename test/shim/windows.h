@@ -0,0 +1,204 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+// Stand-ins for the parts of the Windows API the plugin uses, over POSIX, so the tests build and run off Windows too.
+// Only on the include path there; see windows.cpp for how closely each follows the real thing.
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+
+
+#define WINAPI
+#define __stdcall
+
+typedef int BOOL;
+typedef unsigned char BYTE;
+typedef std::uint16_t WORD;
+typedef std::uint32_t DWORD, UINT;
+typedef std::int32_t LONG;
+typedef std::int64_t LONGLONG;
+typedef LONG LSTATUS;
+typedef std::uintptr_t ULONG_PTR, WPARAM;
+typedef std::intptr_t LPARAM, LRESULT;
+typedef wchar_t WCHAR;
+typedef char * LPSTR;
+typedef const char * LPCSTR;
+typedef void * HANDLE;
+typedef HANDLE HWND, HINSTANCE, HKEY;
+
+#define TRUE 1
+#define FALSE 0
+#define MAX_PATH 260
+#define INFINITE 0xFFFFFFFF
+#define INVALID_HANDLE_VALUE (reinterpret_cast<HANDLE>(-1))
+#define INVALID_FILE_ATTRIBUTES (static_cast<DWORD>(-1))
+
+#define ERROR_SUCCESS 0
+#define ERROR_FILE_NOT_FOUND 2
+#define ERROR_ACCESS_DENIED 5
+#define ERROR_HANDLE_EOF 38
+#define ERROR_INVALID_PARAMETER 87
+#define ERROR_MORE_DATA 234
+#define ERROR_IO_INCOMPLETE 996
+#define ERROR_IO_PENDING 997
+
+#define GENERIC_READ 0x80000000
+#define GENERIC_WRITE 0x40000000
+#define FILE_WRITE_ATTRIBUTES 0x100
+#define FILE_SHARE_READ 0x1
+#define FILE_SHARE_WRITE 0x2
+#define FILE_SHARE_DELETE 0x4
+#define CREATE_NEW 1
+#define CREATE_ALWAYS 2
+#define OPEN_EXISTING 3
+#define OPEN_ALWAYS 4
+#define TRUNCATE_EXISTING 5
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#define FILE_ATTRIBUTE_NORMAL 0x80
+#define FILE_ATTRIBUTE_SPARSE_FILE 0x200
+#define FILE_FLAG_WRITE_THROUGH 0x80000000
+#define FILE_FLAG_OVERLAPPED 0x40000000
+#define FILE_FLAG_SEQUENTIAL_SCAN 0x08000000
+#define FILE_FLAG_DELETE_ON_CLOSE 0x04000000
+#define FILE_BEGIN 0
+#define FILE_CURRENT 1
+#define FILE_END 2
+
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define FILE_MAP_WRITE 0x2
+#define FILE_MAP_READ 0x4
+
+#define WAIT_OBJECT_0 0
+#define WAIT_FAILED 0xFFFFFFFF
+#define QS_ALLINPUT 0x04FF
+#define PM_REMOVE 0x1
+#define WM_QUIT 0x12
+#define MB_OK 0x0
+#define MB_ICONWARNING 0x30
+#define SW_SHOWDEFAULT 10
+
+#define HKEY_CURRENT_USER (reinterpret_cast<HKEY>(0x80000001))
+#define HKEY_LOCAL_MACHINE (reinterpret_cast<HKEY>(0x80000002))
+#define RRF_RT_REG_SZ 0x2
+#define RRF_RT_REG_EXPAND_SZ 0x4
+
+#define CP_ACP 0
+#define CP_UTF8 65001
+
+
+typedef struct {
+	DWORD dwLowDateTime, dwHighDateTime;
+} FILETIME;
+
+typedef struct {
+	WORD wYear, wMonth, wDayOfWeek, wDay, wHour, wMinute, wSecond, wMilliseconds;
+} SYSTEMTIME;
+
+typedef union {
+	struct {
+		DWORD LowPart;
+		LONG HighPart;
+	};
+	LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+typedef struct {
+	ULONG_PTR Internal, InternalHigh;
+	union {
+		struct {
+			DWORD Offset, OffsetHigh;
+		};
+		void * Pointer;
+	};
+	HANDLE hEvent;
+} OVERLAPPED;
+
+typedef struct {
+	DWORD dwFileAttributes;
+	FILETIME ftCreationTime, ftLastAccessTime, ftLastWriteTime;
+	DWORD nFileSizeHigh, nFileSizeLow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+
+typedef enum { GetFileExInfoStandard } GET_FILEEX_INFO_LEVELS;
+
+typedef struct {
+	HWND hwnd;
+	UINT message;
+	WPARAM wParam;
+	LPARAM lParam;
+	DWORD time;
+} MSG;
+
+
+DWORD GetLastError();
+BOOL CloseHandle(HANDLE object);
+
+HANDLE CreateFileA(LPCSTR name, DWORD access, DWORD share, void * security, DWORD disposition, DWORD flags, HANDLE templ);
+BOOL ReadFile(HANDLE file, void * buf, DWORD len, DWORD * read, OVERLAPPED * overlapped);
+BOOL WriteFile(HANDLE file, const void * buf, DWORD len, DWORD * written, OVERLAPPED * overlapped);
+BOOL GetOverlappedResult(HANDLE file, OVERLAPPED * overlapped, DWORD * transferred, BOOL wait);
+BOOL CancelIoEx(HANDLE file, OVERLAPPED * overlapped);
+BOOL FlushFileBuffers(HANDLE file);
+BOOL GetFileSizeEx(HANDLE file, LARGE_INTEGER * size);
+BOOL SetFilePointerEx(HANDLE file, LARGE_INTEGER distance, LARGE_INTEGER * position, DWORD method);
+BOOL SetEndOfFile(HANDLE file);
+BOOL GetFileTime(HANDLE file, FILETIME * creation, FILETIME * access, FILETIME * write);
+BOOL SetFileTime(HANDLE file, const FILETIME * creation, const FILETIME * access, const FILETIME * write);
+DWORD GetFileAttributesA(LPCSTR name);
+BOOL GetFileAttributesExA(LPCSTR name, GET_FILEEX_INFO_LEVELS level, void * info);
+DWORD GetTempPathA(DWORD len, LPSTR buf);
+BOOL DeviceIoControl(HANDLE file, DWORD code, void * in, DWORD in_len, void * out, DWORD out_len, DWORD * returned, OVERLAPPED * overlapped);
+
+HANDLE CreateFileMappingA(HANDLE file, void * security, DWORD protection, DWORD size_high, DWORD size_low, LPCSTR name);
+void * MapViewOfFile(HANDLE mapping, DWORD access, DWORD offset_high, DWORD offset_low, std::size_t len);
+BOOL UnmapViewOfFile(const void * view);
+
+HANDLE CreateEventA(void * security, BOOL manual_reset, BOOL initial_state, LPCSTR name);
+BOOL SetEvent(HANDLE event);
+DWORD WaitForSingleObject(HANDLE object, DWORD timeout);
+DWORD MsgWaitForMultipleObjects(DWORD count, const HANDLE * objects, BOOL all, DWORD timeout, DWORD wake_mask);
+
+BOOL PeekMessageA(MSG * msg, HWND window, UINT min, UINT max, UINT remove);
+BOOL TranslateMessage(const MSG * msg);
+LRESULT DispatchMessageA(const MSG * msg);
+void PostQuitMessage(int code);
+int MessageBoxA(HWND parent, LPCSTR text, LPCSTR caption, UINT type);
+
+BOOL FileTimeToSystemTime(const FILETIME * from, SYSTEMTIME * to);
+int MultiByteToWideChar(UINT codepage, DWORD flags, LPCSTR from, int from_len, WCHAR * to, int to_len);
+int WideCharToMultiByte(UINT codepage, DWORD flags, const WCHAR * from, int from_len, LPSTR to, int to_len, LPCSTR default_char, BOOL * used_default);
+
+LSTATUS RegGetValueA(HKEY key, LPCSTR subkey, LPCSTR value, DWORD flags, DWORD * type, void * data, DWORD * len);
+DWORD ExpandEnvironmentStringsA(LPCSTR from, LPSTR to, DWORD len);
+
+#define CreateFileMapping CreateFileMappingA
+#define CreateEvent CreateEventA
+#define PeekMessage PeekMessageA
+#define DispatchMessage DispatchMessageA
+#define MessageBox MessageBoxA
+#define RegGetValue RegGetValueA
+#define ExpandEnvironmentStrings ExpandEnvironmentStringsA
@@ -0,0 +1,87 @@
+// The MIT License (MIT)
+
+// Copyright (c) 2017 nabijaczleweli
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy of
+// this software and associated documentation files (the "Software"), to deal in
+// the Software without restriction, including without limitation the rights to
+// use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+// the Software, and to permit persons to whom the Software is furnished to do so,
+// subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+// FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+// COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+// IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+// CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+
+#pragma once
+
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+#include "../src/config.hpp"
+#include "wcxhead.h"
+#define WCX_PLUGIN_EXPORTS  // Same calling convention as the plugin's
+#include "wcxapi.h"
+
+
+/// Not in the WCX API headers.
+extern "C" WCX_API int STDCALL ReadArchiveContent(HANDLE hArcData, char * Buffer, int Size, int * Read);
+
+
+/// Report a failed check, with what was being checked.
+///
+/// Return value: ok.
+bool check(bool ok, std::string_view what);
+
+/// Return value: how many checks have failed so far.
+std::size_t failures();
+
+
+/// Return value: a reproducible mix of text, structured binary, and random data, as pseudo-random as seed.
+std::string generate_corpus(std::size_t len, std::uint32_t seed);
+
+/// Return value: the settings every test starts from, with the previous ones removed: the defaults, without autotuning,
+/// and as few threads as packing in parallel takes, so runs allocate the same.
+configuration base_configuration();
+
+/// A directory of the tests' own, with a trailing separator.
+const std::string & scratch_dir();
+
+std::string read_whole(const std::string & path);
+void write_whole(const std::string & path, const std::string & data);
+
+/// Return value: the archive decoded by the zstd library itself, nullopt if it can't be.
+std::optional<std::string> stock_decompress(const std::string & archive);
+
+
+struct allocation_count {
+	std::uint64_t count, bytes;
+};
+
+/// Return value: operator new calls, from all threads, since the start.
+allocation_count allocations();
+
+
+/// Round-trip generated data through every packing and unpacking entry point, with all sizes of buffers,
+/// comparing with what the zstd library itself makes of it.
+void round_trip_tests();
+
+/// Time packing and unpacking, and count allocations, then compare with, or record, the baseline at the specified path.
+///
+/// Throughput is only compared if asked, since it's only comparable on the machine the baseline was recorded on.
+void performance_tests(const char * baseline_path, bool record, bool throughput);